@@ -0,0 +1,145 @@
+#ifndef AABB_H_
+#define AABB_H_
+
+#include <cfloat>
+
+#include "Common.h"
+#include "Ray.h"
+#include "Vector3F.h"
+
+struct AABB
+{
+	Vector3F minimum;
+	Vector3F maximum;
+
+	AABB() :
+		minimum(FLT_MAX, FLT_MAX, FLT_MAX),
+		maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+	{
+	}
+
+	AABB(const Vector3F& rMinimum, const Vector3F& rMaximum) :
+		minimum(rMinimum),
+		maximum(rMaximum)
+	{
+	}
+
+	~AABB()
+	{
+	}
+
+	inline bool IsEmpty() const
+	{
+		return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+	}
+
+	inline void Expand(const Vector3F& rPoint)
+	{
+		minimum.x() = srt_min(minimum.x(), rPoint.x());
+		minimum.y() = srt_min(minimum.y(), rPoint.y());
+		minimum.z() = srt_min(minimum.z(), rPoint.z());
+
+		maximum.x() = srt_max(maximum.x(), rPoint.x());
+		maximum.y() = srt_max(maximum.y(), rPoint.y());
+		maximum.z() = srt_max(maximum.z(), rPoint.z());
+	}
+
+	inline void Expand(const AABB& rOther)
+	{
+		minimum.x() = srt_min(minimum.x(), rOther.minimum.x());
+		minimum.y() = srt_min(minimum.y(), rOther.minimum.y());
+		minimum.z() = srt_min(minimum.z(), rOther.minimum.z());
+
+		maximum.x() = srt_max(maximum.x(), rOther.maximum.x());
+		maximum.y() = srt_max(maximum.y(), rOther.maximum.y());
+		maximum.z() = srt_max(maximum.z(), rOther.maximum.z());
+	}
+
+	inline bool Contains(const Vector3F& rPoint) const
+	{
+		return rPoint.x() >= minimum.x() && rPoint.x() <= maximum.x() &&
+			rPoint.y() >= minimum.y() && rPoint.y() <= maximum.y() &&
+			rPoint.z() >= minimum.z() && rPoint.z() <= maximum.z();
+	}
+
+	// shrinks the box to its overlap with rOther (the result is empty if they are disjoint)
+	inline void Clip(const AABB& rOther)
+	{
+		minimum.x() = srt_max(minimum.x(), rOther.minimum.x());
+		minimum.y() = srt_max(minimum.y(), rOther.minimum.y());
+		minimum.z() = srt_max(minimum.z(), rOther.minimum.z());
+
+		maximum.x() = srt_min(maximum.x(), rOther.maximum.x());
+		maximum.y() = srt_min(maximum.y(), rOther.maximum.y());
+		maximum.z() = srt_min(maximum.z(), rOther.maximum.z());
+	}
+
+	inline Vector3F Centroid() const
+	{
+		return (minimum + maximum) * 0.5f;
+	}
+
+	inline Vector3F Extent() const
+	{
+		return maximum - minimum;
+	}
+
+	inline unsigned int LongestAxis() const
+	{
+		Vector3F extent = Extent();
+		if (extent.x() > extent.y() && extent.x() > extent.z())
+		{
+			return 0;
+		}
+		return (extent.y() > extent.z()) ? 1 : 2;
+	}
+
+	inline float SurfaceArea() const
+	{
+		if (IsEmpty())
+		{
+			return 0;
+		}
+		Vector3F extent = Extent();
+		return 2.0f * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+	}
+
+	inline bool operator == (const AABB& rOther) const
+	{
+		return minimum == rOther.minimum && maximum == rOther.maximum;
+	}
+
+	inline bool operator != (const AABB& rOther) const
+	{
+		return !(*this == rOther);
+	}
+
+	// slab test over the interval of the ray. the sign bits pick the near and far plane of every slab, so there's no swap to branch on.
+	// NaN (0 * inf) means the ray runs parallel to the slab, starting on one of its planes, which counts as inside:
+	// srt_max/srt_min keep their second argument when the first one is NaN, so the slab is skipped
+	inline bool Intersect(const Ray& rRay, float& rTEntry) const
+	{
+		float tExit;
+		return Intersect(rRay, rTEntry, tExit);
+	}
+
+	inline bool Intersect(const Ray& rRay, float& rTEntry, float& rTExit) const
+	{
+		const Vector3F* pBounds[2] = { &minimum, &maximum };
+		float tMin = rRay.tMin;
+		float tMax = rRay.tMax;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			float tNear = ((*pBounds[rRay.sign[i]])[i] - rRay.origin[i]) * rRay.inverseDirection[i];
+			float tFar = ((*pBounds[1 - rRay.sign[i]])[i] - rRay.origin[i]) * rRay.inverseDirection[i];
+			tMin = srt_max(tNear, tMin);
+			tMax = srt_min(tFar, tMax);
+		}
+		rTEntry = tMin;
+		rTExit = tMax;
+		return tMin <= tMax;
+	}
+
+};
+
+#endif
\ No newline at end of file
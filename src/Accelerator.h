@@ -0,0 +1,85 @@
+#ifndef ACCELERATOR_H_
+#define ACCELERATOR_H_
+
+#include <vector>
+
+#include "AABB.h"
+#include "Ray.h"
+#include "RayPacket.h"
+
+// spatial index over a set of primitive bounds (e.g., the scene objects)
+class Accelerator
+{
+public:
+	typedef bool (*IntersectPrimitiveFunction)(void* pContext, unsigned int primitiveIndex);
+	typedef unsigned long long (*IntersectPrimitivePacketFunction)(void* pContext, unsigned int primitiveIndex, unsigned long long rayMask);
+
+	virtual ~Accelerator() = default;
+
+	// called every frame with the current primitive bounds
+	virtual void Update(const std::vector<AABB>& rPrimitiveBounds) = 0;
+	virtual void Clear() = 0;
+
+	// bytes taken by the index
+	virtual size_t GetMemory() const = 0;
+
+	// visits the primitives that may be hit by the ray inside [rRay.tMin, rRay.tMax], roughly front to back.
+	// intersectPrimitive(primitiveIndex) returns true on a hit and shrinks rRay.tMax to the hit distance.
+	// a primitive can be visited more than once. with anyHit set traversal stops at the first hit
+	template <typename IntersectPrimitive>
+	inline bool Traverse(const Ray& rRay, IntersectPrimitive intersectPrimitive, bool anyHit = false) const
+	{
+		return Traverse(rRay, &Invoke<IntersectPrimitive>, &intersectPrimitive, anyHit);
+	}
+
+	virtual bool Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const = 0;
+
+	// closest-hit traversal of the rays of rayMask in a packet. intersectPrimitive(primitiveIndex, rayMask) tests the
+	// primitive against the given rays, shrinks rPacket.tMax of the ones it hits and returns their mask
+	template <typename IntersectPrimitivePacket>
+	inline unsigned long long TraversePacket(RayPacket& rPacket, unsigned long long rayMask, IntersectPrimitivePacket intersectPrimitive) const
+	{
+		return TraversePacket(rPacket, rayMask, &InvokePacket<IntersectPrimitivePacket>, &intersectPrimitive);
+	}
+
+	// indices that have no packet traversal of their own trace the rays one by one
+	virtual unsigned long long TraversePacket(RayPacket& rPacket, unsigned long long rayMask, IntersectPrimitivePacketFunction intersectPrimitive, void* pContext) const
+	{
+		unsigned long long hits = 0;
+		for (; rayMask != 0; rayMask &= rayMask - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rayMask);
+			unsigned long long ray = RayPacket::Bit(i);
+			Ray singleRay = rPacket.GetRay(i);
+			if (Traverse(singleRay, [&](unsigned int primitiveIndex)
+			{
+				bool hit = intersectPrimitive(pContext, primitiveIndex, ray) != 0;
+				singleRay.tMax = rPacket.tMax[i];
+				return hit;
+			}))
+			{
+				hits |= ray;
+			}
+		}
+		return hits;
+	}
+
+protected:
+	Accelerator() = default;
+
+private:
+	template <typename IntersectPrimitive>
+	static bool Invoke(void* pContext, unsigned int primitiveIndex)
+	{
+		return (*static_cast<IntersectPrimitive*>(pContext))(primitiveIndex);
+	}
+
+	template <typename IntersectPrimitivePacket>
+	static unsigned long long InvokePacket(void* pContext, unsigned int primitiveIndex, unsigned long long rayMask)
+	{
+		return (*static_cast<IntersectPrimitivePacket*>(pContext))(primitiveIndex, rayMask);
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,983 @@
+#include <algorithm>
+#include <utility>
+
+#include "BVH.h"
+#include "Morton.h"
+#include "TaskScheduler.h"
+
+const float BVH::SAH_TRAVERSAL_COST = 0.125f;
+const float BVH::SAH_INTERSECTION_COST = 1.0f;
+const unsigned int BVH::PARALLEL_BUILD_THRESHOLD = 4096;
+const float BVH::SPATIAL_SPLIT_OVERLAP = 1e-5f;
+
+thread_local BVHStatistics BVH::s_mStatistics;
+
+// a primitive, or the piece of it a spatial split left on one side of the split plane
+struct BVH::PrimitiveReference
+{
+	AABB bounds;
+	unsigned int primitive;
+
+};
+
+struct BVH::SpatialSplitBuild
+{
+	const std::vector<AABB>& rPrimitiveBounds;
+	const ClipPrimitiveFunction& rClipPrimitive;
+	float rootArea;
+	// references that can still be duplicated
+	unsigned int budget;
+
+	SpatialSplitBuild(const std::vector<AABB>& rPrimitiveBounds, const ClipPrimitiveFunction& rClipPrimitive, float rootArea, unsigned int budget) :
+		rPrimitiveBounds(rPrimitiveBounds),
+		rClipPrimitive(rClipPrimitive),
+		rootArea(rootArea),
+		budget(budget)
+	{
+	}
+
+	// bounds of the part of a reference between two planes on axis
+	AABB Clip(const PrimitiveReference& rReference, unsigned int axis, float minimum, float maximum) const
+	{
+		AABB bounds;
+		if (rClipPrimitive)
+		{
+			bounds = rClipPrimitive(rReference.primitive, axis, minimum, maximum);
+		}
+		else
+		{
+			bounds = rPrimitiveBounds[rReference.primitive];
+			bounds.minimum[axis] = srt_max(bounds.minimum[axis], minimum);
+			bounds.maximum[axis] = srt_min(bounds.maximum[axis], maximum);
+		}
+		bounds.Clip(rReference.bounds);
+		return bounds;
+	}
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+BVH::BVH() :
+	mNumberOfPrimitives(0),
+	mSAHCost(0),
+	mBuildSAHCost(0),
+	mTraversalCost(0),
+	mFullPrecisionTraversalCost(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::Build(const std::vector<AABB>& rPrimitiveBounds, const BVHSettings& rSettings, const ClipPrimitiveFunction& rClipPrimitive)
+{
+	Clear();
+
+	mSettings = rSettings;
+	mSettings.maxLeafSize = srt_max(mSettings.maxLeafSize, 1u);
+	mSettings.numberOfBins = srt_max(mSettings.numberOfBins, 2u);
+	mSettings.width = (mSettings.width <= 2) ? 2 : ((mSettings.width <= 4) ? 4 : 8);
+	mSettings.quantizationBits = (mSettings.width == 2 || mSettings.quantizationBits == 0) ? 0 : ((mSettings.quantizationBits <= 8) ? 8 : 16);
+
+	if (rPrimitiveBounds.empty())
+	{
+		return;
+	}
+
+	mNumberOfPrimitives = static_cast<unsigned int>(rPrimitiveBounds.size());
+	std::vector<Vector3F> centroids(mNumberOfPrimitives);
+	mPrimitiveIndices.resize(mNumberOfPrimitives);
+	TaskScheduler::GetInstance().ParallelFor(0, mNumberOfPrimitives, PARALLEL_BUILD_THRESHOLD, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+		{
+			centroids[i] = rPrimitiveBounds[i].Centroid();
+			mPrimitiveIndices[i] = i;
+		}
+	});
+
+	bool linear = (mSettings.builder == BB_LINEAR) || (mSettings.builder == BB_AUTO && mNumberOfPrimitives >= mSettings.linearBuildThreshold);
+
+	mNodes.reserve(2 * mNumberOfPrimitives - 1);
+	if (mSettings.builder == BB_SPATIAL_SPLITS)
+	{
+		std::vector<PrimitiveReference> references(mNumberOfPrimitives);
+		AABB bounds;
+		for (unsigned int i = 0; i < mNumberOfPrimitives; i++)
+		{
+			references[i].bounds = rPrimitiveBounds[i];
+			references[i].primitive = i;
+			bounds.Expand(rPrimitiveBounds[i]);
+		}
+		// references are appended to the list as leaves are created
+		mPrimitiveIndices.clear();
+		SpatialSplitBuild build(rPrimitiveBounds, rClipPrimitive, bounds.SurfaceArea(), static_cast<unsigned int>(mNumberOfPrimitives * srt_max(mSettings.spatialSplitBudget, 0.0f)));
+		BuildSpatialSplits(build, references, 0);
+	}
+	else if (linear)
+	{
+		std::vector<unsigned int> mortonCodes;
+		SortByMortonCode(centroids, mortonCodes);
+		BuildLinear(mNodes, rPrimitiveBounds, mortonCodes, 0, mNumberOfPrimitives, 0);
+	}
+	else
+	{
+		BuildBinnedSAH(mNodes, rPrimitiveBounds, centroids, 0, mNumberOfPrimitives, 0);
+	}
+	Collapse();
+
+	mSAHCost = mBuildSAHCost = ComputeSAHCost();
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool BVH::Update(const std::vector<AABB>& rPrimitiveBounds, const BVHSettings& rSettings, const ClipPrimitiveFunction& rClipPrimitive)
+{
+	if (mNodes.empty() || rPrimitiveBounds.size() != mNumberOfPrimitives)
+	{
+		Build(rPrimitiveBounds, rSettings, rClipPrimitive);
+		return true;
+	}
+
+	// refitted leaves bound whole primitives again, not just the pieces spatial splits assigned to them
+	Refit(rPrimitiveBounds);
+
+	if (mSAHCost > mBuildSAHCost * rSettings.rebuildThreshold)
+	{
+		Build(rPrimitiveBounds, rSettings, rClipPrimitive);
+		return true;
+	}
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::Refit(const std::vector<AABB>& rPrimitiveBounds)
+{
+	// children are always stored after their parent, so a reverse sweep updates them first
+	for (unsigned int i = static_cast<unsigned int>(mNodes.size()); i-- > 0;)
+	{
+		BVHNode& rNode = mNodes[i];
+		AABB bounds;
+		if (rNode.IsLeaf())
+		{
+			for (unsigned int j = rNode.offset; j < rNode.offset + rNode.count; j++)
+			{
+				bounds.Expand(rPrimitiveBounds[mPrimitiveIndices[j]]);
+			}
+		}
+		else
+		{
+			bounds = mNodes[i + 1].bounds;
+			bounds.Expand(mNodes[rNode.offset].bounds);
+		}
+		rNode.bounds = bounds;
+	}
+	Collapse();
+
+	mSAHCost = ComputeSAHCost();
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::Clear()
+{
+	mNodes.clear();
+	mWideNodes4.clear();
+	mWideNodes8.clear();
+	mQuantizedNodes4x8.clear();
+	mQuantizedNodes4x16.clear();
+	mQuantizedNodes8x8.clear();
+	mQuantizedNodes8x16.clear();
+	mPrimitiveIndices.clear();
+	mNumberOfPrimitives = 0;
+	mSAHCost = mBuildSAHCost = 0;
+	mTraversalCost = mFullPrecisionTraversalCost = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+float BVH::ComputeSAHCost() const
+{
+	if (mNodes.empty())
+	{
+		return 0;
+	}
+
+	float rootArea = mNodes[0].bounds.SurfaceArea();
+	if (rootArea <= 0)
+	{
+		return SAH_INTERSECTION_COST * mNumberOfPrimitives;
+	}
+
+	float cost = 0;
+	for (unsigned int i = 0; i < mNodes.size(); i++)
+	{
+		const BVHNode& rNode = mNodes[i];
+		float area = rNode.bounds.SurfaceArea() / rootArea;
+		cost += rNode.IsLeaf() ? area * SAH_INTERSECTION_COST * rNode.count : area * SAH_TRAVERSAL_COST;
+	}
+	return cost;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::EvaluateSplitAxis(const std::vector<AABB>& rPrimitiveBounds, const std::vector<Vector3F>& rCentroids, unsigned int start, unsigned int end, const AABB& rCentroidBounds, unsigned int axis, float& rBestCost, unsigned int& rBestSplit) const
+{
+	rBestCost = FLT_MAX;
+	rBestSplit = 0;
+
+	float centroidExtent = rCentroidBounds.maximum[axis] - rCentroidBounds.minimum[axis];
+	if (centroidExtent <= 0)
+	{
+		return;
+	}
+
+	unsigned int numberOfBins = mSettings.numberOfBins;
+	std::vector<AABB> binBounds(numberOfBins);
+	std::vector<unsigned int> binCounts(numberOfBins);
+	std::vector<float> rightAreas(numberOfBins);
+
+	float binScale = numberOfBins / centroidExtent;
+	for (unsigned int i = start; i < end; i++)
+	{
+		unsigned int primitive = mPrimitiveIndices[i];
+		unsigned int bin = srt_min(static_cast<unsigned int>((rCentroids[primitive][axis] - rCentroidBounds.minimum[axis]) * binScale), numberOfBins - 1);
+		binBounds[bin].Expand(rPrimitiveBounds[primitive]);
+		binCounts[bin]++;
+	}
+
+	AABB rightBounds;
+	for (unsigned int i = numberOfBins - 1; i > 0; i--)
+	{
+		rightBounds.Expand(binBounds[i]);
+		rightAreas[i] = rightBounds.SurfaceArea();
+	}
+
+	AABB leftBounds;
+	unsigned int count = end - start;
+	unsigned int leftCount = 0;
+	for (unsigned int i = 1; i < numberOfBins; i++)
+	{
+		leftBounds.Expand(binBounds[i - 1]);
+		leftCount += binCounts[i - 1];
+		unsigned int rightCount = count - leftCount;
+		if (leftCount == 0 || rightCount == 0)
+		{
+			continue;
+		}
+
+		float cost = leftBounds.SurfaceArea() * leftCount + rightAreas[i] * rightCount;
+		if (cost < rBestCost)
+		{
+			rBestCost = cost;
+			rBestSplit = i;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::BuildBinnedSAH(std::vector<BVHNode>& rNodes, const std::vector<AABB>& rPrimitiveBounds, const std::vector<Vector3F>& rCentroids, unsigned int start, unsigned int end, unsigned int depth)
+{
+	unsigned int nodeIndex = static_cast<unsigned int>(rNodes.size());
+	rNodes.emplace_back();
+
+	AABB bounds;
+	AABB centroidBounds;
+	for (unsigned int i = start; i < end; i++)
+	{
+		bounds.Expand(rPrimitiveBounds[mPrimitiveIndices[i]]);
+		centroidBounds.Expand(rCentroids[mPrimitiveIndices[i]]);
+	}
+	rNodes[nodeIndex].bounds = bounds;
+
+	unsigned int count = end - start;
+	if (count == 1 || depth >= MAX_DEPTH)
+	{
+		rNodes[nodeIndex].offset = start;
+		rNodes[nodeIndex].count = count;
+		return;
+	}
+
+	// binned surface area heuristic: primitives are bucketed by centroid and the plane between
+	// two buckets with the smallest expected intersection cost is chosen among all three axes
+	float axisCosts[3];
+	unsigned int axisSplits[3];
+	if (count >= PARALLEL_BUILD_THRESHOLD)
+	{
+		TaskScheduler& rScheduler = TaskScheduler::GetInstance();
+		TaskGroup group;
+		for (unsigned int axis = 0; axis < 2; axis++)
+		{
+			rScheduler.Spawn(group, [&, axis]()
+			{
+				EvaluateSplitAxis(rPrimitiveBounds, rCentroids, start, end, centroidBounds, axis, axisCosts[axis], axisSplits[axis]);
+			});
+		}
+		EvaluateSplitAxis(rPrimitiveBounds, rCentroids, start, end, centroidBounds, 2, axisCosts[2], axisSplits[2]);
+		rScheduler.Wait(group);
+	}
+	else
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			EvaluateSplitAxis(rPrimitiveBounds, rCentroids, start, end, centroidBounds, axis, axisCosts[axis], axisSplits[axis]);
+		}
+	}
+
+	// ties go to the lower axis
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 0;
+	unsigned int bestSplit = 0;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		if (axisCosts[axis] < bestCost)
+		{
+			bestCost = axisCosts[axis];
+			bestAxis = axis;
+			bestSplit = axisSplits[axis];
+		}
+	}
+
+	bool hasSplit = (bestCost != FLT_MAX);
+	float leafCost = SAH_INTERSECTION_COST * count;
+	float nodeArea = bounds.SurfaceArea();
+	if (hasSplit && nodeArea > 0)
+	{
+		bestCost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * bestCost / nodeArea;
+	}
+
+	if (count <= mSettings.maxLeafSize && leafCost <= bestCost)
+	{
+		rNodes[nodeIndex].offset = start;
+		rNodes[nodeIndex].count = count;
+		return;
+	}
+
+	unsigned int middle;
+	if (hasSplit)
+	{
+		unsigned int numberOfBins = mSettings.numberOfBins;
+		float binScale = numberOfBins / (centroidBounds.maximum[bestAxis] - centroidBounds.minimum[bestAxis]);
+		float axisMinimum = centroidBounds.minimum[bestAxis];
+		middle = static_cast<unsigned int>(std::partition(mPrimitiveIndices.begin() + start, mPrimitiveIndices.begin() + end, [&](unsigned int primitive)
+		{
+			return srt_min(static_cast<unsigned int>((rCentroids[primitive][bestAxis] - axisMinimum) * binScale), numberOfBins - 1) < bestSplit;
+		}) - mPrimitiveIndices.begin());
+	}
+	else
+	{
+		// every centroid falls in the same spot, split the list in half
+		middle = start + count / 2;
+	}
+
+	unsigned int secondChild;
+	if (count >= PARALLEL_BUILD_THRESHOLD)
+	{
+		// the halves own disjoint ranges of the primitive references, so they are built at the same time into
+		// separate node lists and appended in depth-first order, which gives the same tree as a serial build
+		std::vector<BVHNode> firstSubtree, secondSubtree;
+		TaskGroup group;
+		TaskScheduler::GetInstance().Spawn(group, [&]()
+		{
+			BuildBinnedSAH(firstSubtree, rPrimitiveBounds, rCentroids, start, middle, depth + 1);
+		});
+		BuildBinnedSAH(secondSubtree, rPrimitiveBounds, rCentroids, middle, end, depth + 1);
+		TaskScheduler::GetInstance().Wait(group);
+
+		AppendSubtree(rNodes, firstSubtree);
+		secondChild = static_cast<unsigned int>(rNodes.size());
+		AppendSubtree(rNodes, secondSubtree);
+	}
+	else
+	{
+		BuildBinnedSAH(rNodes, rPrimitiveBounds, rCentroids, start, middle, depth + 1);
+		secondChild = static_cast<unsigned int>(rNodes.size());
+		BuildBinnedSAH(rNodes, rPrimitiveBounds, rCentroids, middle, end, depth + 1);
+	}
+
+	rNodes[nodeIndex].offset = secondChild;
+	rNodes[nodeIndex].count = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::SortByMortonCode(const std::vector<Vector3F>& rCentroids, std::vector<unsigned int>& rMortonCodes)
+{
+	TaskScheduler& rScheduler = TaskScheduler::GetInstance();
+	unsigned int numberOfPrimitives = static_cast<unsigned int>(rCentroids.size());
+
+	AABB centroidBounds;
+	for (unsigned int i = 0; i < numberOfPrimitives; i++)
+	{
+		centroidBounds.Expand(rCentroids[i]);
+	}
+
+	// codes are sorted together with the primitive index, which also makes equal codes keep a deterministic order
+	std::vector<std::pair<unsigned int, unsigned int> > keys(numberOfPrimitives);
+	rScheduler.ParallelFor(0, numberOfPrimitives, PARALLEL_BUILD_THRESHOLD, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+		{
+			keys[i].first = Morton::Encode(rCentroids[i], centroidBounds);
+			keys[i].second = i;
+		}
+	});
+
+	// chunks are sorted in parallel, then merged pairwise
+	unsigned int chunkSize = srt_max((numberOfPrimitives + rScheduler.NumberOfThreads() - 1) / rScheduler.NumberOfThreads(), PARALLEL_BUILD_THRESHOLD);
+	rScheduler.ParallelFor(0, numberOfPrimitives, chunkSize, [&](unsigned int first, unsigned int last)
+	{
+		std::sort(keys.begin() + first, keys.begin() + last);
+	});
+	for (unsigned int width = chunkSize; width < numberOfPrimitives; width *= 2)
+	{
+		TaskGroup group;
+		for (unsigned int first = 0; first + width < numberOfPrimitives; first += 2 * width)
+		{
+			unsigned int middle = first + width;
+			unsigned int last = srt_min(first + 2 * width, numberOfPrimitives);
+			rScheduler.Spawn(group, [&keys, first, middle, last]()
+			{
+				std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+			});
+		}
+		rScheduler.Wait(group);
+	}
+
+	rMortonCodes.resize(numberOfPrimitives);
+	for (unsigned int i = 0; i < numberOfPrimitives; i++)
+	{
+		rMortonCodes[i] = keys[i].first;
+		mPrimitiveIndices[i] = keys[i].second;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::BuildLinear(std::vector<BVHNode>& rNodes, const std::vector<AABB>& rPrimitiveBounds, const std::vector<unsigned int>& rMortonCodes, unsigned int start, unsigned int end, unsigned int depth)
+{
+	unsigned int nodeIndex = static_cast<unsigned int>(rNodes.size());
+	rNodes.emplace_back();
+
+	unsigned int count = end - start;
+	if (count <= mSettings.maxLeafSize || depth >= MAX_DEPTH)
+	{
+		AABB bounds;
+		for (unsigned int i = start; i < end; i++)
+		{
+			bounds.Expand(rPrimitiveBounds[mPrimitiveIndices[i]]);
+		}
+		rNodes[nodeIndex].bounds = bounds;
+		rNodes[nodeIndex].offset = start;
+		rNodes[nodeIndex].count = count;
+		return;
+	}
+
+	// the primitives are sorted along the z-order curve: the range is split where the highest differing bit of
+	// its codes flips, halving the range's cell of the morton lattice. equal codes are split in the middle
+	unsigned int middle;
+	unsigned int firstCode = rMortonCodes[start];
+	unsigned int lastCode = rMortonCodes[end - 1];
+	if (firstCode == lastCode)
+	{
+		middle = start + count / 2;
+	}
+	else
+	{
+		unsigned int bit = 1u << Morton::HighestBit(firstCode ^ lastCode);
+		middle = static_cast<unsigned int>(std::partition_point(rMortonCodes.begin() + start, rMortonCodes.begin() + end, [bit](unsigned int code)
+		{
+			return (code & bit) == 0;
+		}) - rMortonCodes.begin());
+	}
+
+	unsigned int secondChild;
+	if (count >= PARALLEL_BUILD_THRESHOLD)
+	{
+		std::vector<BVHNode> firstSubtree, secondSubtree;
+		TaskGroup group;
+		TaskScheduler::GetInstance().Spawn(group, [&]()
+		{
+			BuildLinear(firstSubtree, rPrimitiveBounds, rMortonCodes, start, middle, depth + 1);
+		});
+		BuildLinear(secondSubtree, rPrimitiveBounds, rMortonCodes, middle, end, depth + 1);
+		TaskScheduler::GetInstance().Wait(group);
+
+		AppendSubtree(rNodes, firstSubtree);
+		secondChild = static_cast<unsigned int>(rNodes.size());
+		AppendSubtree(rNodes, secondSubtree);
+	}
+	else
+	{
+		BuildLinear(rNodes, rPrimitiveBounds, rMortonCodes, start, middle, depth + 1);
+		secondChild = static_cast<unsigned int>(rNodes.size());
+		BuildLinear(rNodes, rPrimitiveBounds, rMortonCodes, middle, end, depth + 1);
+	}
+
+	AABB bounds = rNodes[nodeIndex + 1].bounds;
+	bounds.Expand(rNodes[secondChild].bounds);
+	rNodes[nodeIndex].bounds = bounds;
+	rNodes[nodeIndex].offset = secondChild;
+	rNodes[nodeIndex].count = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::BuildSpatialSplits(SpatialSplitBuild& rBuild, std::vector<PrimitiveReference>& rReferences, unsigned int depth)
+{
+	unsigned int nodeIndex = static_cast<unsigned int>(mNodes.size());
+	mNodes.emplace_back();
+
+	AABB bounds;
+	AABB centroidBounds;
+	for (auto& rReference : rReferences)
+	{
+		bounds.Expand(rReference.bounds);
+		centroidBounds.Expand(rReference.bounds.Centroid());
+	}
+	mNodes[nodeIndex].bounds = bounds;
+
+	unsigned int count = static_cast<unsigned int>(rReferences.size());
+	unsigned int numberOfBins = mSettings.numberOfBins;
+	bool leaf = (count == 1 || depth >= MAX_DEPTH);
+
+	// object split: binned SAH over the reference centroids, as in BuildBinnedSAH
+	float objectCost = FLT_MAX;
+	unsigned int objectAxis = 0, objectSplit = 0;
+	AABB objectLeftBounds, objectRightBounds;
+	std::vector<AABB> binBounds(numberOfBins);
+	std::vector<unsigned int> binCounts(numberOfBins);
+	std::vector<unsigned int> binExits(numberOfBins);
+	std::vector<AABB> rightBounds(numberOfBins);
+	for (unsigned int axis = 0; axis < 3 && !leaf; axis++)
+	{
+		float centroidExtent = centroidBounds.maximum[axis] - centroidBounds.minimum[axis];
+		if (centroidExtent <= 0)
+		{
+			continue;
+		}
+
+		std::fill(binBounds.begin(), binBounds.end(), AABB());
+		std::fill(binCounts.begin(), binCounts.end(), 0);
+		float binScale = numberOfBins / centroidExtent;
+		for (auto& rReference : rReferences)
+		{
+			unsigned int bin = srt_min(static_cast<unsigned int>((rReference.bounds.Centroid()[axis] - centroidBounds.minimum[axis]) * binScale), numberOfBins - 1);
+			binBounds[bin].Expand(rReference.bounds);
+			binCounts[bin]++;
+		}
+
+		rightBounds[numberOfBins - 1] = binBounds[numberOfBins - 1];
+		for (unsigned int i = numberOfBins - 1; i-- > 1;)
+		{
+			rightBounds[i] = rightBounds[i + 1];
+			rightBounds[i].Expand(binBounds[i]);
+		}
+
+		AABB leftBounds;
+		unsigned int leftCount = 0;
+		for (unsigned int i = 1; i < numberOfBins; i++)
+		{
+			leftBounds.Expand(binBounds[i - 1]);
+			leftCount += binCounts[i - 1];
+			unsigned int rightCount = count - leftCount;
+			if (leftCount == 0 || rightCount == 0)
+			{
+				continue;
+			}
+
+			float cost = leftBounds.SurfaceArea() * leftCount + rightBounds[i].SurfaceArea() * rightCount;
+			if (cost < objectCost)
+			{
+				objectCost = cost;
+				objectAxis = axis;
+				objectSplit = i;
+				objectLeftBounds = leftBounds;
+				objectRightBounds = rightBounds[i];
+			}
+		}
+	}
+
+	// spatial split: bins span the node bounds and references are clipped into every bin they cover. only worth
+	// the extra references when the object split children overlap considerably
+	float spatialCost = FLT_MAX;
+	unsigned int spatialAxis = 0, spatialSplit = 0;
+	AABB spatialLeftBounds, spatialRightBounds;
+	unsigned int spatialLeftCount = 0, spatialRightCount = 0;
+	AABB overlap = objectLeftBounds;
+	overlap.Clip(objectRightBounds);
+	if (!leaf && rBuild.budget > 0 && objectCost != FLT_MAX && overlap.SurfaceArea() > SPATIAL_SPLIT_OVERLAP * rBuild.rootArea)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float extent = bounds.maximum[axis] - bounds.minimum[axis];
+			if (extent <= 0)
+			{
+				continue;
+			}
+
+			std::fill(binBounds.begin(), binBounds.end(), AABB());
+			std::fill(binCounts.begin(), binCounts.end(), 0);
+			std::fill(binExits.begin(), binExits.end(), 0);
+			float binWidth = extent / numberOfBins;
+			float binScale = numberOfBins / extent;
+			for (auto& rReference : rReferences)
+			{
+				unsigned int firstBin = srt_min(static_cast<unsigned int>((rReference.bounds.minimum[axis] - bounds.minimum[axis]) * binScale), numberOfBins - 1);
+				unsigned int lastBin = srt_min(static_cast<unsigned int>((rReference.bounds.maximum[axis] - bounds.minimum[axis]) * binScale), numberOfBins - 1);
+				if (firstBin == lastBin)
+				{
+					binBounds[firstBin].Expand(rReference.bounds);
+				}
+				else
+				{
+					for (unsigned int bin = firstBin; bin <= lastBin; bin++)
+					{
+						float binMinimum = (bin == firstBin) ? rReference.bounds.minimum[axis] : bounds.minimum[axis] + bin * binWidth;
+						float binMaximum = (bin == lastBin) ? rReference.bounds.maximum[axis] : bounds.minimum[axis] + (bin + 1) * binWidth;
+						binBounds[bin].Expand(rBuild.Clip(rReference, axis, binMinimum, binMaximum));
+					}
+				}
+				// counted on entering the first bin and on leaving the last
+				binCounts[firstBin]++;
+				binExits[lastBin]++;
+			}
+
+			rightBounds[numberOfBins - 1] = binBounds[numberOfBins - 1];
+			for (unsigned int i = numberOfBins - 1; i-- > 1;)
+			{
+				rightBounds[i] = rightBounds[i + 1];
+				rightBounds[i].Expand(binBounds[i]);
+			}
+
+			AABB leftBounds;
+			unsigned int leftCount = 0;
+			unsigned int rightCount = count;
+			for (unsigned int i = 1; i < numberOfBins; i++)
+			{
+				leftBounds.Expand(binBounds[i - 1]);
+				leftCount += binCounts[i - 1];
+				rightCount -= binExits[i - 1];
+				if (leftCount == 0 || rightCount == 0)
+				{
+					continue;
+				}
+
+				float cost = leftBounds.SurfaceArea() * leftCount + rightBounds[i].SurfaceArea() * rightCount;
+				if (cost < spatialCost)
+				{
+					spatialCost = cost;
+					spatialAxis = axis;
+					spatialSplit = i;
+					spatialLeftBounds = leftBounds;
+					spatialRightBounds = rightBounds[i];
+					spatialLeftCount = leftCount;
+					spatialRightCount = rightCount;
+				}
+			}
+		}
+	}
+
+	float bestCost = srt_min(objectCost, spatialCost);
+	float leafCost = SAH_INTERSECTION_COST * count;
+	float nodeArea = bounds.SurfaceArea();
+	if (bestCost != FLT_MAX && nodeArea > 0)
+	{
+		bestCost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * bestCost / nodeArea;
+	}
+
+	if (leaf || (count <= mSettings.maxLeafSize && leafCost <= bestCost))
+	{
+		mNodes[nodeIndex].offset = static_cast<unsigned int>(mPrimitiveIndices.size());
+		mNodes[nodeIndex].count = count;
+		for (auto& rReference : rReferences)
+		{
+			mPrimitiveIndices.push_back(rReference.primitive);
+		}
+		return;
+	}
+
+	std::vector<PrimitiveReference> leftReferences, rightReferences;
+	if (spatialCost < objectCost)
+	{
+		float plane = bounds.minimum[spatialAxis] + spatialSplit * ((bounds.maximum[spatialAxis] - bounds.minimum[spatialAxis]) / numberOfBins);
+		std::vector<PrimitiveReference> straddling;
+		for (auto& rReference : rReferences)
+		{
+			if (rReference.bounds.maximum[spatialAxis] <= plane)
+			{
+				leftReferences.push_back(rReference);
+			}
+			else if (rReference.bounds.minimum[spatialAxis] >= plane)
+			{
+				rightReferences.push_back(rReference);
+			}
+			else
+			{
+				straddling.push_back(rReference);
+			}
+		}
+
+		// reference unsplitting: a straddling reference goes entirely to one side when that is cheaper than
+		// splitting it, or when the duplication budget is spent
+		float leftArea = spatialLeftBounds.SurfaceArea(), rightArea = spatialRightBounds.SurfaceArea();
+		for (auto& rReference : straddling)
+		{
+			PrimitiveReference leftReference = rReference, rightReference = rReference;
+			leftReference.bounds = rBuild.Clip(rReference, spatialAxis, rReference.bounds.minimum[spatialAxis], plane);
+			rightReference.bounds = rBuild.Clip(rReference, spatialAxis, plane, rReference.bounds.maximum[spatialAxis]);
+
+			AABB leftUnsplit = spatialLeftBounds, rightUnsplit = spatialRightBounds;
+			leftUnsplit.Expand(rReference.bounds);
+			rightUnsplit.Expand(rReference.bounds);
+			float splitCost = leftArea * spatialLeftCount + rightArea * spatialRightCount;
+			float leftOnlyCost = leftUnsplit.SurfaceArea() * spatialLeftCount + rightArea * (spatialRightCount - 1);
+			float rightOnlyCost = leftArea * (spatialLeftCount - 1) + rightUnsplit.SurfaceArea() * spatialRightCount;
+
+			bool split = (rBuild.budget > 0 && !leftReference.bounds.IsEmpty() && !rightReference.bounds.IsEmpty() && splitCost < leftOnlyCost && splitCost < rightOnlyCost);
+			if (split)
+			{
+				leftReferences.push_back(leftReference);
+				rightReferences.push_back(rightReference);
+				rBuild.budget--;
+			}
+			else if (leftOnlyCost <= rightOnlyCost)
+			{
+				leftReferences.push_back(rReference);
+				spatialLeftBounds = leftUnsplit;
+				leftArea = spatialLeftBounds.SurfaceArea();
+				spatialRightCount--;
+			}
+			else
+			{
+				rightReferences.push_back(rReference);
+				spatialRightBounds = rightUnsplit;
+				rightArea = spatialRightBounds.SurfaceArea();
+				spatialLeftCount--;
+			}
+		}
+	}
+
+	if (leftReferences.empty() || rightReferences.empty())
+	{
+		leftReferences.clear();
+		rightReferences.clear();
+		if (objectCost != FLT_MAX)
+		{
+			float binScale = numberOfBins / (centroidBounds.maximum[objectAxis] - centroidBounds.minimum[objectAxis]);
+			for (auto& rReference : rReferences)
+			{
+				unsigned int bin = srt_min(static_cast<unsigned int>((rReference.bounds.Centroid()[objectAxis] - centroidBounds.minimum[objectAxis]) * binScale), numberOfBins - 1);
+				((bin < objectSplit) ? leftReferences : rightReferences).push_back(rReference);
+			}
+		}
+		else
+		{
+			// every centroid falls in the same spot, split the list in half
+			leftReferences.assign(rReferences.begin(), rReferences.begin() + count / 2);
+			rightReferences.assign(rReferences.begin() + count / 2, rReferences.end());
+		}
+	}
+
+	// the parent's references aren't needed anymore
+	std::vector<PrimitiveReference>().swap(rReferences);
+
+	BuildSpatialSplits(rBuild, leftReferences, depth + 1);
+	unsigned int secondChild = static_cast<unsigned int>(mNodes.size());
+	BuildSpatialSplits(rBuild, rightReferences, depth + 1);
+
+	mNodes[nodeIndex].offset = secondChild;
+	mNodes[nodeIndex].count = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::AppendSubtree(std::vector<BVHNode>& rNodes, const std::vector<BVHNode>& rSubtree)
+{
+	// interior offsets are relative to the subtree's own list
+	unsigned int base = static_cast<unsigned int>(rNodes.size());
+	rNodes.insert(rNodes.end(), rSubtree.begin(), rSubtree.end());
+	for (unsigned int i = base; i < rNodes.size(); i++)
+	{
+		if (!rNodes[i].IsLeaf())
+		{
+			rNodes[i].offset += base;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void BVH::Collapse()
+{
+	mWideNodes4.clear();
+	mWideNodes8.clear();
+	mQuantizedNodes4x8.clear();
+	mQuantizedNodes4x16.clear();
+	mQuantizedNodes8x8.clear();
+	mQuantizedNodes8x16.clear();
+	mTraversalCost = mFullPrecisionTraversalCost = 0;
+
+	if (mNodes.empty())
+	{
+		return;
+	}
+
+	if (mSettings.width == 8)
+	{
+		CollapseRecursive(mWideNodes8, 0);
+		mTraversalCost = mFullPrecisionTraversalCost = ComputeWideSAHCost(mWideNodes8);
+		if (mSettings.quantizationBits == 8)
+		{
+			Quantize(mWideNodes8, mQuantizedNodes8x8);
+			mTraversalCost = ComputeWideSAHCost(mQuantizedNodes8x8);
+		}
+		else if (mSettings.quantizationBits == 16)
+		{
+			Quantize(mWideNodes8, mQuantizedNodes8x16);
+			mTraversalCost = ComputeWideSAHCost(mQuantizedNodes8x16);
+		}
+	}
+	else if (mSettings.width == 4)
+	{
+		CollapseRecursive(mWideNodes4, 0);
+		mTraversalCost = mFullPrecisionTraversalCost = ComputeWideSAHCost(mWideNodes4);
+		if (mSettings.quantizationBits == 8)
+		{
+			Quantize(mWideNodes4, mQuantizedNodes4x8);
+			mTraversalCost = ComputeWideSAHCost(mQuantizedNodes4x8);
+		}
+		else if (mSettings.quantizationBits == 16)
+		{
+			Quantize(mWideNodes4, mQuantizedNodes4x16);
+			mTraversalCost = ComputeWideSAHCost(mQuantizedNodes4x16);
+		}
+	}
+	else
+	{
+		mTraversalCost = mFullPrecisionTraversalCost = ComputeSAHCost();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+template <unsigned int N, typename T>
+void BVH::Quantize(std::vector<WideBVHNode<N> >& rWideNodes, std::vector<QuantizedBVHNode<N, T> >& rQuantizedNodes)
+{
+	rQuantizedNodes.resize(rWideNodes.size());
+	for (unsigned int i = 0; i < rWideNodes.size(); i++)
+	{
+		rQuantizedNodes[i].Quantize(rWideNodes[i]);
+	}
+	// the full precision nodes are not kept around, saving their memory is the point of quantizing
+	std::vector<WideBVHNode<N> >().swap(rWideNodes);
+}
+
+//////////////////////////////////////////////////////////////////////////
+template <typename Node>
+float BVH::ComputeWideSAHCost(const std::vector<Node>& rWideNodes) const
+{
+	float rootArea = mNodes[0].bounds.SurfaceArea();
+	if (rootArea <= 0)
+	{
+		return SAH_INTERSECTION_COST * mNumberOfPrimitives;
+	}
+
+	// every wide node costs one traversal step, weighted by the probability of a ray hitting its bounds
+	float cost = SAH_TRAVERSAL_COST;
+	for (unsigned int i = 0; i < rWideNodes.size(); i++)
+	{
+		const Node& rNode = rWideNodes[i];
+		for (unsigned int j = 0; j < rNode.numberOfChildren; j++)
+		{
+			float area = rNode.GetChildBounds(j).SurfaceArea() / rootArea;
+			cost += (rNode.count[j] > 0) ? area * SAH_INTERSECTION_COST * rNode.count[j] : area * SAH_TRAVERSAL_COST;
+		}
+	}
+	return cost;
+}
+
+//////////////////////////////////////////////////////////////////////////
+size_t BVH::GetMemory() const
+{
+	return mNodes.size() * sizeof(BVHNode) + mPrimitiveIndices.size() * sizeof(unsigned int) +
+		mWideNodes4.size() * sizeof(WideBVHNode<4>) + mWideNodes8.size() * sizeof(WideBVHNode<8>) +
+		mQuantizedNodes4x8.size() * sizeof(QuantizedBVHNode<4, unsigned char>) + mQuantizedNodes4x16.size() * sizeof(QuantizedBVHNode<4, unsigned short>) +
+		mQuantizedNodes8x8.size() * sizeof(QuantizedBVHNode<8, unsigned char>) + mQuantizedNodes8x16.size() * sizeof(QuantizedBVHNode<8, unsigned short>);
+}
+
+//////////////////////////////////////////////////////////////////////////
+size_t BVH::GetFullPrecisionMemory() const
+{
+	return mNodes.size() * sizeof(BVHNode) + mPrimitiveIndices.size() * sizeof(unsigned int) +
+		(mWideNodes4.size() + mQuantizedNodes4x8.size() + mQuantizedNodes4x16.size()) * sizeof(WideBVHNode<4>) +
+		(mWideNodes8.size() + mQuantizedNodes8x8.size() + mQuantizedNodes8x16.size()) * sizeof(WideBVHNode<8>);
+}
+
+//////////////////////////////////////////////////////////////////////////
+template <unsigned int N>
+unsigned int BVH::CollapseRecursive(std::vector<WideBVHNode<N> >& rWideNodes, unsigned int node)
+{
+	unsigned int wideNodeIndex = static_cast<unsigned int>(rWideNodes.size());
+	rWideNodes.emplace_back();
+
+	// the binary children are opened up, largest interior node first, until the wide node is full
+	unsigned int children[N];
+	unsigned int numberOfChildren;
+	if (mNodes[node].IsLeaf())
+	{
+		children[0] = node;
+		numberOfChildren = 1;
+	}
+	else
+	{
+		children[0] = node + 1;
+		children[1] = mNodes[node].offset;
+		numberOfChildren = 2;
+	}
+
+	while (numberOfChildren < N)
+	{
+		unsigned int largest = UINT_MAX;
+		float largestArea = -1;
+		for (unsigned int i = 0; i < numberOfChildren; i++)
+		{
+			const BVHNode& rChild = mNodes[children[i]];
+			if (!rChild.IsLeaf() && rChild.bounds.SurfaceArea() > largestArea)
+			{
+				largest = i;
+				largestArea = rChild.bounds.SurfaceArea();
+			}
+		}
+
+		if (largest == UINT_MAX)
+		{
+			break;
+		}
+
+		unsigned int opened = children[largest];
+		children[largest] = opened + 1;
+		children[numberOfChildren++] = mNodes[opened].offset;
+	}
+
+	rWideNodes[wideNodeIndex].numberOfChildren = numberOfChildren;
+	for (unsigned int i = 0; i < N; i++)
+	{
+		// unused slots are masked out by the child count
+		AABB bounds = (i < numberOfChildren) ? mNodes[children[i]].bounds : AABB(Vector3F(), Vector3F());
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			rWideNodes[wideNodeIndex].minimum[axis][i] = bounds.minimum[axis];
+			rWideNodes[wideNodeIndex].maximum[axis][i] = bounds.maximum[axis];
+		}
+		rWideNodes[wideNodeIndex].offset[i] = 0;
+		rWideNodes[wideNodeIndex].count[i] = 0;
+	}
+
+	for (unsigned int i = 0; i < numberOfChildren; i++)
+	{
+		const BVHNode& rChild = mNodes[children[i]];
+		if (rChild.IsLeaf())
+		{
+			rWideNodes[wideNodeIndex].offset[i] = rChild.offset;
+			rWideNodes[wideNodeIndex].count[i] = rChild.count;
+		}
+		else
+		{
+			// the vector may grow during the recursion, so the slot is only written afterwards
+			unsigned int childWideNode = CollapseRecursive(rWideNodes, children[i]);
+			rWideNodes[wideNodeIndex].offset[i] = childWideNode;
+		}
+	}
+
+	return wideNodeIndex;
+}
\ No newline at end of file
@@ -0,0 +1,793 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <vector>
+#include <functional>
+#include <climits>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "AABB.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "Vector3F.h"
+
+struct BVHNode
+{
+	AABB bounds;
+	// leaf: index of the first primitive reference, interior: index of the second child (the first child is always the next node)
+	unsigned int offset;
+	// number of primitive references, 0 for interior nodes
+	unsigned int count;
+
+	BVHNode() :
+		offset(0),
+		count(0)
+	{
+	}
+
+	inline bool IsLeaf() const
+	{
+		return count > 0;
+	}
+
+};
+
+// bounds of up to N children in SoA form, so a ray is tested against all of them at once
+template <unsigned int N>
+struct WideBVHNode
+{
+	static const unsigned int WIDTH = N;
+
+	float minimum[3][N];
+	float maximum[3][N];
+	// interior child: index of its wide node, leaf child: index of its first primitive reference
+	unsigned int offset[N];
+	// number of primitive references, 0 for interior children
+	unsigned int count[N];
+	unsigned int numberOfChildren;
+
+	inline AABB GetChildBounds(unsigned int i) const
+	{
+		return AABB(Vector3F(minimum[0][i], minimum[1][i], minimum[2][i]), Vector3F(maximum[0][i], maximum[1][i], maximum[2][i]));
+	}
+
+};
+
+// compressed wide node: child bounds are stored as 8 or 16 bit offsets on a lattice spanning the node's own bounds.
+// they are rounded outwards when quantized, so the dequantized boxes always contain the real ones
+template <unsigned int N, typename T>
+struct QuantizedBVHNode
+{
+	static const unsigned int WIDTH = N;
+	static const unsigned int LEVELS = static_cast<T>(~0u);
+
+	// lattice point q of an axis is at origin + q * scale
+	float origin[3];
+	float scale[3];
+	T minimum[3][N];
+	T maximum[3][N];
+	unsigned int offset[N];
+	unsigned int count[N];
+	unsigned int numberOfChildren;
+
+	inline float Dequantize(unsigned int axis, unsigned int q) const
+	{
+		return origin[axis] + static_cast<float>(q) * scale[axis];
+	}
+
+	void Quantize(const WideBVHNode<N>& rNode)
+	{
+		numberOfChildren = rNode.numberOfChildren;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float nodeMinimum = FLT_MAX, nodeMaximum = -FLT_MAX;
+			for (unsigned int i = 0; i < numberOfChildren; i++)
+			{
+				nodeMinimum = srt_min(nodeMinimum, rNode.minimum[axis][i]);
+				nodeMaximum = srt_max(nodeMaximum, rNode.maximum[axis][i]);
+			}
+
+			origin[axis] = nodeMinimum;
+			scale[axis] = (nodeMaximum - nodeMinimum) / LEVELS;
+			// the last lattice point must not fall short of the node bounds because of rounding
+			while (Dequantize(axis, LEVELS) < nodeMaximum)
+			{
+				scale[axis] = std::nextafter(scale[axis], FLT_MAX);
+			}
+
+			for (unsigned int i = 0; i < N; i++)
+			{
+				unsigned int qMinimum = 0, qMaximum = 0;
+				if (i < numberOfChildren && scale[axis] > 0)
+				{
+					qMinimum = static_cast<unsigned int>(srt_max(std::floor((rNode.minimum[axis][i] - origin[axis]) / scale[axis]), 0.0f));
+					qMaximum = static_cast<unsigned int>(srt_min(std::ceil((rNode.maximum[axis][i] - origin[axis]) / scale[axis]), static_cast<float>(LEVELS)));
+					while (qMinimum > 0 && Dequantize(axis, qMinimum) > rNode.minimum[axis][i])
+					{
+						qMinimum--;
+					}
+					while (qMaximum < LEVELS && Dequantize(axis, qMaximum) < rNode.maximum[axis][i])
+					{
+						qMaximum++;
+					}
+				}
+				minimum[axis][i] = static_cast<T>(qMinimum);
+				maximum[axis][i] = static_cast<T>(qMaximum);
+			}
+		}
+
+		for (unsigned int i = 0; i < N; i++)
+		{
+			offset[i] = rNode.offset[i];
+			count[i] = rNode.count[i];
+		}
+	}
+
+	inline AABB GetChildBounds(unsigned int i) const
+	{
+		return AABB(Vector3F(Dequantize(0, minimum[0][i]), Dequantize(1, minimum[1][i]), Dequantize(2, minimum[2][i])), Vector3F(Dequantize(0, maximum[0][i]), Dequantize(1, maximum[1][i]), Dequantize(2, maximum[2][i])));
+	}
+
+	// conservative child bounds, for the SIMD slab test
+	void Dequantize(WideBVHNode<N>& rNode) const
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				rNode.minimum[axis][i] = Dequantize(axis, minimum[axis][i]);
+				rNode.maximum[axis][i] = Dequantize(axis, maximum[axis][i]);
+			}
+		}
+		rNode.numberOfChildren = numberOfChildren;
+	}
+
+};
+
+struct BVHStatistics
+{
+	// interior nodes whose children were tested against a ray
+	unsigned long long nodeVisits;
+	unsigned long long primitiveTests;
+
+	BVHStatistics() :
+		nodeVisits(0),
+		primitiveTests(0)
+	{
+	}
+
+};
+
+enum BVHBuilder
+{
+	BB_AUTO, BB_BINNED_SAH, BB_LINEAR, BB_SPATIAL_SPLITS
+};
+
+struct BVHSettings
+{
+	// nodes with more primitives than this are always split
+	unsigned int maxLeafSize;
+	// number of buckets the surface area heuristic evaluates split planes at, per axis
+	unsigned int numberOfBins;
+	// a refitted hierarchy (e.g., the scene-level one over moving objects) is rebuilt once its SAH cost exceeds the cost it was built with by this factor
+	float rebuildThreshold;
+	// children per node at traversal time (2, 4 or 8). the binary tree is collapsed into wide nodes after every build/refit
+	unsigned int width;
+	// bits per wide node child bound (8 or 16), 0 keeps them as floats. binary trees are never quantized
+	unsigned int quantizationBits;
+	// binned SAH builds better trees, linear (morton code) builds are several times faster.
+	// BB_AUTO picks the linear builder from linearBuildThreshold primitives on
+	// BB_SPATIAL_SPLITS (SBVH) also splits primitives across planes, referencing them from both sides
+	BVHBuilder builder;
+	unsigned int linearBuildThreshold;
+	// extra primitive references spatial splits may create, relative to the number of primitives
+	float spatialSplitBudget;
+
+	BVHSettings() :
+		maxLeafSize(4),
+		numberOfBins(16),
+		rebuildThreshold(1.5f),
+		width(4),
+		quantizationBits(0),
+		builder(BB_AUTO),
+		linearBuildThreshold(1 << 20),
+		spatialSplitBudget(0.3f)
+	{
+	}
+
+	BVHSettings(unsigned int maxLeafSize, unsigned int numberOfBins, float rebuildThreshold = 1.5f, unsigned int width = 4, unsigned int quantizationBits = 0, BVHBuilder builder = BB_AUTO) :
+		maxLeafSize(maxLeafSize),
+		numberOfBins(numberOfBins),
+		rebuildThreshold(rebuildThreshold),
+		width(width),
+		quantizationBits(quantizationBits),
+		builder(builder),
+		linearBuildThreshold(1 << 20),
+		spatialSplitBudget(0.3f)
+	{
+	}
+
+};
+
+// bounds of the part of a primitive between two planes perpendicular to an axis.
+// spatial splits use it to bound the pieces of a primitive cut by a split plane
+typedef std::function<AABB(unsigned int primitive, unsigned int axis, float minimum, float maximum)> ClipPrimitiveFunction;
+
+class BVH
+{
+public:
+	BVH();
+	~BVH() = default;
+
+	// rClipPrimitive is only used by spatial split builds, without it primitives are clipped as boxes
+	void Build(const std::vector<AABB>& rPrimitiveBounds, const BVHSettings& rSettings = BVHSettings(), const ClipPrimitiveFunction& rClipPrimitive = nullptr);
+	// refits the node bounds to the new primitive bounds and falls back to a full build when the primitive count
+	// changed or the refitted tree got too expensive to traverse. returns true if the hierarchy was rebuilt
+	bool Update(const std::vector<AABB>& rPrimitiveBounds, const BVHSettings& rSettings = BVHSettings(), const ClipPrimitiveFunction& rClipPrimitive = nullptr);
+	void Refit(const std::vector<AABB>& rPrimitiveBounds);
+	void Clear();
+
+	// expected cost of a random ray traversal (surface area heuristic, relative to the root bounds)
+	inline float GetSAHCost() const
+	{
+		return mSAHCost;
+	}
+
+	inline float GetBuildSAHCost() const
+	{
+		return mBuildSAHCost;
+	}
+
+	inline bool IsEmpty() const
+	{
+		return mNodes.empty();
+	}
+
+	inline const AABB& GetBounds() const
+	{
+		return mNodes[0].bounds;
+	}
+
+	inline unsigned int NumberOfNodes() const
+	{
+		return static_cast<unsigned int>(mNodes.size());
+	}
+
+	inline unsigned int NumberOfPrimitives() const
+	{
+		return mNumberOfPrimitives;
+	}
+
+	// primitives split by spatial splits are referenced by more than one leaf
+	inline unsigned int NumberOfReferences() const
+	{
+		return static_cast<unsigned int>(mPrimitiveIndices.size());
+	}
+
+	inline BVHBuilder GetBuilder() const
+	{
+		return mSettings.builder;
+	}
+
+	inline unsigned int GetWidth() const
+	{
+		return mSettings.width;
+	}
+
+	inline unsigned int GetQuantizationBits() const
+	{
+		return mSettings.quantizationBits;
+	}
+
+	// bytes taken by everything the hierarchy keeps: the binary nodes (refitting and packet traversal run on them),
+	// the primitive indices and the wide or quantized nodes
+	size_t GetMemory() const;
+
+	// bytes the same hierarchy would take with full precision wide nodes
+	size_t GetFullPrecisionMemory() const;
+
+	// expected cost of a random ray traversal of the nodes traversal runs on (surface area heuristic, relative to the root bounds).
+	// quantized bounds are looser, so it grows with the precision lost
+	inline float GetTraversalCost() const
+	{
+		return mTraversalCost;
+	}
+
+	inline float GetFullPrecisionTraversalCost() const
+	{
+		return mFullPrecisionTraversalCost;
+	}
+
+	// traversal counters of the calling thread, accumulated over every hierarchy
+	static inline BVHStatistics& GetStatistics()
+	{
+		return s_mStatistics;
+	}
+
+	static inline void ResetStatistics()
+	{
+		s_mStatistics = BVHStatistics();
+	}
+
+	// primitive references in leaf order: leaves cover contiguous ranges of it
+	inline const std::vector<unsigned int>& GetPrimitiveIndices() const
+	{
+		return mPrimitiveIndices;
+	}
+
+	// visits the primitives whose bounds are pierced by the ray inside [rRay.tMin, rRay.tMax], nearest nodes first.
+	// intersectPrimitive(primitiveIndex) returns true on a hit and shrinks rRay.tMax to the hit distance,
+	// which culls every node that starts farther away. with anyHit set traversal stops at the first hit.
+	template <typename IntersectPrimitive>
+	bool Traverse(const Ray& rRay, IntersectPrimitive intersectPrimitive, bool anyHit = false) const
+	{
+		return TraverseLeaves(rRay, [&](unsigned int first, unsigned int count)
+		{
+			bool hit = false;
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				if (intersectPrimitive(mPrimitiveIndices[i]))
+				{
+					hit = true;
+					if (anyHit)
+					{
+						break;
+					}
+				}
+			}
+			return hit;
+		}, anyHit);
+	}
+
+	// same as Traverse, but hands out whole leaves as ranges of GetPrimitiveIndices():
+	// intersectLeaf(first, count) returns true if any of the leaf primitives was hit
+	template <typename IntersectLeaf>
+	bool TraverseLeaves(const Ray& rRay, IntersectLeaf intersectLeaf, bool anyHit = false) const
+	{
+		if (mNodes.empty())
+		{
+			return false;
+		}
+
+		if (mSettings.width == 8)
+		{
+			if (mSettings.quantizationBits == 8)
+			{
+				return TraverseWide(mQuantizedNodes8x8, rRay, intersectLeaf, anyHit);
+			}
+			else if (mSettings.quantizationBits == 16)
+			{
+				return TraverseWide(mQuantizedNodes8x16, rRay, intersectLeaf, anyHit);
+			}
+			return TraverseWide(mWideNodes8, rRay, intersectLeaf, anyHit);
+		}
+		else if (mSettings.width == 4)
+		{
+			if (mSettings.quantizationBits == 8)
+			{
+				return TraverseWide(mQuantizedNodes4x8, rRay, intersectLeaf, anyHit);
+			}
+			else if (mSettings.quantizationBits == 16)
+			{
+				return TraverseWide(mQuantizedNodes4x16, rRay, intersectLeaf, anyHit);
+			}
+			return TraverseWide(mWideNodes4, rRay, intersectLeaf, anyHit);
+		}
+		return TraverseBinary(rRay, intersectLeaf, anyHit);
+	}
+
+	// closest-hit traversal of a packet of coherent rays over the binary tree. every node is first tested against the
+	// bounds of the packet (interval culling) and then against each ray still active in it. once a single ray is left, the
+	// subtree is finished with regular single ray traversal. intersectLeaf(first, count, rayMask) tests the leaf
+	// against the rays of rayMask, shrinks rPacket.tMax of the rays it hits and returns their mask
+	template <typename IntersectPacketLeaf>
+	unsigned long long TraversePacket(RayPacket& rPacket, unsigned long long rayMask, IntersectPacketLeaf intersectLeaf) const
+	{
+		if (mNodes.empty())
+		{
+			return 0;
+		}
+
+		struct StackEntry
+		{
+			unsigned int node;
+			unsigned long long rayMask;
+		} stack[MAX_DEPTH + 1];
+		unsigned int stackSize = 0;
+
+		RayPacket::Interval interval = rPacket.ComputeInterval(rayMask);
+
+		stack[stackSize].node = 0;
+		stack[stackSize++].rayMask = rayMask;
+
+		unsigned long long hits = 0;
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			const BVHNode& rNode = mNodes[entry.node];
+			if (!RayPacket::MayIntersect(interval, rNode.bounds))
+			{
+				continue;
+			}
+
+			// rays diverge as the tree gets deeper, keep only the ones that actually pierce the node
+			unsigned long long activeRays = rPacket.Intersect(rNode.bounds, entry.rayMask);
+			if (activeRays == 0)
+			{
+				continue;
+			}
+
+			if ((activeRays & (activeRays - 1)) == 0)
+			{
+				unsigned int ray = RayPacket::FirstRay(activeRays);
+				Ray singleRay = rPacket.GetRay(ray);
+				bool hit = TraverseBinary(singleRay, [&](unsigned int first, unsigned int count)
+				{
+					bool leafHit = intersectLeaf(first, count, activeRays) != 0;
+					singleRay.tMax = rPacket.tMax[ray];
+					return leafHit;
+				}, false, entry.node);
+				if (hit)
+				{
+					hits |= activeRays;
+				}
+				continue;
+			}
+
+			if (rNode.IsLeaf())
+			{
+				s_mStatistics.primitiveTests += rNode.count;
+				hits |= intersectLeaf(rNode.offset, rNode.count, activeRays);
+				continue;
+			}
+
+			s_mStatistics.nodeVisits++;
+
+			// the rays are coherent, so the child nearer along the first one is taken to be nearer for all of them
+			unsigned int first = entry.node + 1;
+			unsigned int second = rNode.offset;
+			unsigned int ray = RayPacket::FirstRay(activeRays);
+			Vector3F direction(rPacket.directionX[ray], rPacket.directionY[ray], rPacket.directionZ[ray]);
+			Vector3F centroidDelta = (mNodes[second].bounds.minimum + mNodes[second].bounds.maximum) - (mNodes[first].bounds.minimum + mNodes[first].bounds.maximum);
+			if (direction.Dot(centroidDelta) < 0)
+			{
+				unsigned int tmp = first;
+				first = second;
+				second = tmp;
+			}
+			stack[stackSize].node = second;
+			stack[stackSize++].rayMask = activeRays;
+			stack[stackSize].node = first;
+			stack[stackSize++].rayMask = activeRays;
+		}
+
+		return hits;
+	}
+
+	// visits the primitives whose bounds contain a point, over the binary tree. visitPrimitive(primitiveIndex) is called
+	// once per primitive reference
+	template <typename VisitPrimitive>
+	void TraversePoint(const Vector3F& rPoint, VisitPrimitive visitPrimitive) const
+	{
+		if (mNodes.empty())
+		{
+			return;
+		}
+
+		unsigned int stack[MAX_DEPTH + 1];
+		unsigned int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			unsigned int node = stack[--stackSize];
+			const BVHNode& rNode = mNodes[node];
+			if (!rNode.bounds.Contains(rPoint))
+			{
+				continue;
+			}
+
+			if (rNode.IsLeaf())
+			{
+				for (unsigned int i = rNode.offset; i < rNode.offset + rNode.count; i++)
+				{
+					visitPrimitive(mPrimitiveIndices[i]);
+				}
+				continue;
+			}
+
+			stack[stackSize++] = rNode.offset;
+			stack[stackSize++] = node + 1;
+		}
+	}
+
+private:
+	static const unsigned int MAX_DEPTH = 63;
+	static const float SAH_TRAVERSAL_COST;
+	static const float SAH_INTERSECTION_COST;
+	// ranges with at least this many primitives are split up into parallel tasks while building
+	static const unsigned int PARALLEL_BUILD_THRESHOLD;
+	// spatial splits are only tried when the children of the best object split overlap by more than this fraction of the root area
+	static const float SPATIAL_SPLIT_OVERLAP;
+
+	struct PrimitiveReference;
+	struct SpatialSplitBuild;
+
+	static thread_local BVHStatistics s_mStatistics;
+
+	BVHSettings mSettings;
+	std::vector<BVHNode> mNodes;
+	std::vector<WideBVHNode<4> > mWideNodes4;
+	std::vector<WideBVHNode<8> > mWideNodes8;
+	std::vector<QuantizedBVHNode<4, unsigned char> > mQuantizedNodes4x8;
+	std::vector<QuantizedBVHNode<4, unsigned short> > mQuantizedNodes4x16;
+	std::vector<QuantizedBVHNode<8, unsigned char> > mQuantizedNodes8x8;
+	std::vector<QuantizedBVHNode<8, unsigned short> > mQuantizedNodes8x16;
+	std::vector<unsigned int> mPrimitiveIndices;
+	unsigned int mNumberOfPrimitives;
+	float mSAHCost;
+	float mBuildSAHCost;
+	float mTraversalCost;
+	float mFullPrecisionTraversalCost;
+
+	float ComputeSAHCost() const;
+
+	void BuildBinnedSAH(std::vector<BVHNode>& rNodes, const std::vector<AABB>& rPrimitiveBounds, const std::vector<Vector3F>& rCentroids, unsigned int start, unsigned int end, unsigned int depth);
+	void EvaluateSplitAxis(const std::vector<AABB>& rPrimitiveBounds, const std::vector<Vector3F>& rCentroids, unsigned int start, unsigned int end, const AABB& rCentroidBounds, unsigned int axis, float& rBestCost, unsigned int& rBestSplit) const;
+	// sorts the primitive references along the z-order curve of their centroids
+	void SortByMortonCode(const std::vector<Vector3F>& rCentroids, std::vector<unsigned int>& rMortonCodes);
+	void BuildLinear(std::vector<BVHNode>& rNodes, const std::vector<AABB>& rPrimitiveBounds, const std::vector<unsigned int>& rMortonCodes, unsigned int start, unsigned int end, unsigned int depth);
+	void BuildSpatialSplits(SpatialSplitBuild& rBuild, std::vector<PrimitiveReference>& rReferences, unsigned int depth);
+	static void AppendSubtree(std::vector<BVHNode>& rNodes, const std::vector<BVHNode>& rSubtree);
+
+	void Collapse();
+
+	template <unsigned int N>
+	unsigned int CollapseRecursive(std::vector<WideBVHNode<N> >& rWideNodes, unsigned int node);
+
+	// replaces the float wide nodes by quantized ones with the same layout
+	template <unsigned int N, typename T>
+	void Quantize(std::vector<WideBVHNode<N> >& rWideNodes, std::vector<QuantizedBVHNode<N, T> >& rQuantizedNodes);
+
+	template <typename Node>
+	float ComputeWideSAHCost(const std::vector<Node>& rWideNodes) const;
+
+	template <typename IntersectLeaf>
+	bool TraverseBinary(const Ray& rRay, IntersectLeaf intersectLeaf, bool anyHit, unsigned int root = 0) const
+	{
+		struct StackEntry
+		{
+			unsigned int node;
+			float tEntry;
+		} stack[MAX_DEPTH + 1];
+		unsigned int stackSize = 0;
+
+		float tEntry;
+		if (!mNodes[root].bounds.Intersect(rRay, tEntry))
+		{
+			return false;
+		}
+		stack[stackSize].node = root;
+		stack[stackSize++].tEntry = tEntry;
+
+		bool hit = false;
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.tEntry > rRay.tMax)
+			{
+				continue;
+			}
+
+			const BVHNode& rNode = mNodes[entry.node];
+			if (rNode.IsLeaf())
+			{
+				s_mStatistics.primitiveTests += rNode.count;
+				if (intersectLeaf(rNode.offset, rNode.count))
+				{
+					hit = true;
+					if (anyHit)
+					{
+						return true;
+					}
+				}
+				continue;
+			}
+
+			s_mStatistics.nodeVisits++;
+
+			unsigned int first = entry.node + 1;
+			unsigned int second = rNode.offset;
+			float tFirst, tSecond;
+			bool hitFirst = mNodes[first].bounds.Intersect(rRay, tFirst);
+			bool hitSecond = mNodes[second].bounds.Intersect(rRay, tSecond);
+
+			if (hitFirst && hitSecond)
+			{
+				// push the farther child first so that the nearer one is popped next
+				if (tSecond < tFirst)
+				{
+					srt_swap(tFirst, tSecond);
+					unsigned int tmp = first;
+					first = second;
+					second = tmp;
+				}
+				stack[stackSize].node = second;
+				stack[stackSize++].tEntry = tSecond;
+				stack[stackSize].node = first;
+				stack[stackSize++].tEntry = tFirst;
+			}
+			else if (hitFirst)
+			{
+				stack[stackSize].node = first;
+				stack[stackSize++].tEntry = tFirst;
+			}
+			else if (hitSecond)
+			{
+				stack[stackSize].node = second;
+				stack[stackSize++].tEntry = tSecond;
+			}
+		}
+
+		return hit;
+	}
+
+	template <typename Node, typename IntersectLeaf>
+	bool TraverseWide(const std::vector<Node>& rWideNodes, const Ray& rRay, IntersectLeaf intersectLeaf, bool anyHit) const
+	{
+		const unsigned int N = Node::WIDTH;
+
+		float tEntry;
+		if (!mNodes[0].bounds.Intersect(rRay, tEntry))
+		{
+			return false;
+		}
+
+		// count is 0 for wide nodes and the number of primitive references for leaves
+		struct StackEntry
+		{
+			unsigned int offset;
+			unsigned int count;
+			float tEntry;
+		} stack[MAX_DEPTH * (N - 1) + N];
+		unsigned int stackSize = 0;
+
+		stack[stackSize].offset = 0;
+		stack[stackSize].count = 0;
+		stack[stackSize++].tEntry = tEntry;
+
+		bool hit = false;
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.tEntry > rRay.tMax)
+			{
+				continue;
+			}
+
+			if (entry.count > 0)
+			{
+				s_mStatistics.primitiveTests += entry.count;
+				if (intersectLeaf(entry.offset, entry.count))
+				{
+					hit = true;
+					if (anyHit)
+					{
+						return true;
+					}
+				}
+				continue;
+			}
+
+			s_mStatistics.nodeVisits++;
+
+			const Node& rNode = rWideNodes[entry.offset];
+			float tEntries[N];
+			unsigned int mask = IntersectChildren(rNode, rRay, tEntries);
+
+			// sort the hit children by entry distance (insertion sort, N is tiny) and push the farthest first
+			unsigned int children[N];
+			unsigned int numberOfHits = 0;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				if ((mask & (1u << i)) == 0)
+				{
+					continue;
+				}
+				unsigned int j = numberOfHits++;
+				while (j > 0 && tEntries[children[j - 1]] < tEntries[i])
+				{
+					children[j] = children[j - 1];
+					j--;
+				}
+				children[j] = i;
+			}
+
+			for (unsigned int i = 0; i < numberOfHits; i++)
+			{
+				unsigned int child = children[i];
+				stack[stackSize].offset = rNode.offset[child];
+				stack[stackSize].count = rNode.count[child];
+				stack[stackSize++].tEntry = tEntries[child];
+			}
+		}
+
+		return hit;
+	}
+
+	// quantized children are tested with their dequantized (conservative) bounds
+	template <unsigned int N, typename T>
+	static inline unsigned int IntersectChildren(const QuantizedBVHNode<N, T>& rNode, const Ray& rRay, float* pTEntries)
+	{
+		WideBVHNode<N> bounds;
+		rNode.Dequantize(bounds);
+		return IntersectChildren(bounds, rRay, pTEntries);
+	}
+
+	// slab test of all children at once. returns a bit mask of the children hit inside the ray interval and their entry distances.
+	// the sign bits of the ray pick the near and far planes, so every slab takes two subtractions and two multiplications. NaN (0 * inf)
+	// means the ray runs parallel to the slab, starting on one of its planes: min/max return their second operand when either one is NaN,
+	// which leaves tNear/tFar untouched and counts the slab as entered
+	static inline unsigned int IntersectChildren(const WideBVHNode<4>& rNode, const Ray& rRay, float* pTEntries)
+	{
+		__m128 tNear = _mm_set1_ps(rRay.tMin);
+		__m128 tFar = _mm_set1_ps(rRay.tMax);
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			const float* pNear = (rRay.sign[axis]) ? rNode.maximum[axis] : rNode.minimum[axis];
+			const float* pFar = (rRay.sign[axis]) ? rNode.minimum[axis] : rNode.maximum[axis];
+			__m128 origin = _mm_set1_ps(rRay.origin[axis]);
+			__m128 inverseDirection = _mm_set1_ps(rRay.inverseDirection[axis]);
+			tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pNear), origin), inverseDirection), tNear);
+			tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pFar), origin), inverseDirection), tFar);
+		}
+		_mm_storeu_ps(pTEntries, tNear);
+		return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) & ((1u << rNode.numberOfChildren) - 1);
+	}
+
+	static inline unsigned int IntersectChildren(const WideBVHNode<8>& rNode, const Ray& rRay, float* pTEntries)
+	{
+#ifdef __AVX__
+		__m256 tNear = _mm256_set1_ps(rRay.tMin);
+		__m256 tFar = _mm256_set1_ps(rRay.tMax);
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			const float* pNear = (rRay.sign[axis]) ? rNode.maximum[axis] : rNode.minimum[axis];
+			const float* pFar = (rRay.sign[axis]) ? rNode.minimum[axis] : rNode.maximum[axis];
+			__m256 origin = _mm256_set1_ps(rRay.origin[axis]);
+			__m256 inverseDirection = _mm256_set1_ps(rRay.inverseDirection[axis]);
+			tNear = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pNear), origin), inverseDirection), tNear);
+			tFar = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pFar), origin), inverseDirection), tFar);
+		}
+		_mm256_storeu_ps(pTEntries, tNear);
+		return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ))) & ((1u << rNode.numberOfChildren) - 1);
+#else
+		// without AVX the node is tested as two SSE halves
+		unsigned int mask = 0;
+		for (unsigned int half = 0; half < 2; half++)
+		{
+			__m128 tNear = _mm_set1_ps(rRay.tMin);
+			__m128 tFar = _mm_set1_ps(rRay.tMax);
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				const float* pNear = (rRay.sign[axis]) ? rNode.maximum[axis] : rNode.minimum[axis];
+				const float* pFar = (rRay.sign[axis]) ? rNode.minimum[axis] : rNode.maximum[axis];
+				__m128 origin = _mm_set1_ps(rRay.origin[axis]);
+				__m128 inverseDirection = _mm_set1_ps(rRay.inverseDirection[axis]);
+				tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pNear + half * 4), origin), inverseDirection), tNear);
+				tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pFar + half * 4), origin), inverseDirection), tFar);
+			}
+			_mm_storeu_ps(pTEntries + half * 4, tNear);
+			mask |= static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) << (half * 4);
+		}
+		return mask & ((1u << rNode.numberOfChildren) - 1);
+#endif
+	}
+
+};
+
+#endif
\ No newline at end of file
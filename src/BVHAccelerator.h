@@ -0,0 +1,61 @@
+#ifndef BVHACCELERATOR_H_
+#define BVHACCELERATOR_H_
+
+#include "Accelerator.h"
+#include "BVH.h"
+
+class BVHAccelerator : public Accelerator
+{
+public:
+	BVHAccelerator(const BVHSettings& rSettings = BVHSettings()) :
+		mSettings(rSettings)
+	{
+	}
+
+	virtual ~BVHAccelerator() = default;
+
+	// moving primitives only refit the hierarchy, it's rebuilt when they moved too far apart
+	virtual void Update(const std::vector<AABB>& rPrimitiveBounds)
+	{
+		mBVH.Update(rPrimitiveBounds, mSettings);
+	}
+
+	virtual void Clear()
+	{
+		mBVH.Clear();
+	}
+
+	virtual size_t GetMemory() const
+	{
+		return mBVH.GetMemory();
+	}
+
+	virtual bool Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const
+	{
+		return mBVH.Traverse(rRay, [&](unsigned int primitiveIndex)
+		{
+			return intersectPrimitive(pContext, primitiveIndex);
+		}, anyHit);
+	}
+
+	virtual unsigned long long TraversePacket(RayPacket& rPacket, unsigned long long rayMask, IntersectPrimitivePacketFunction intersectPrimitive, void* pContext) const
+	{
+		return mBVH.TraversePacket(rPacket, rayMask, [&](unsigned int first, unsigned int count, unsigned long long leafRayMask)
+		{
+			unsigned long long hits = 0;
+			const std::vector<unsigned int>& rPrimitiveIndices = mBVH.GetPrimitiveIndices();
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				hits |= intersectPrimitive(pContext, rPrimitiveIndices[i], leafRayMask);
+			}
+			return hits;
+		});
+	}
+
+private:
+	BVHSettings mSettings;
+	BVH mBVH;
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef BOUNDINGBOX_H_
+#define BOUNDINGBOX_H_
+
+#include "OBB.h"
+
+// box aligned to the object space axes: an OBB that skips the principal axes analysis
+struct BoundingBox : public OBB
+{
+	virtual ~BoundingBox()
+	{
+	}
+
+	virtual bool Compute(const std::vector<Vector3F>& rPoints)
+	{
+		if (rPoints.empty())
+		{
+			return false;
+		}
+
+		ComputeExtents(rPoints);
+
+		return true;
+	}
+
+	virtual std::unique_ptr<BoundingVolume> Clone() const
+	{
+		return std::unique_ptr<BoundingVolume>(new BoundingBox(*this));
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -1,6 +1,12 @@
 #ifndef BOUNDINGSPHERE_H_
 #define BOUNDINGSPHERE_H_
 
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
 #include "BoundingVolume.h"
 #include "Common.h"
 
@@ -20,31 +26,81 @@ public:
 	{
 	}
 
+	// minimal enclosing sphere (Welzl's algorithm, in its incremental form: expected linear time on shuffled points)
 	virtual bool Compute(const std::vector<Vector3F>& rPoints)
 	{
-		for (unsigned int i = 0; i < rPoints.size(); i++)
+		center = Vector3F();
+		radius = 0;
+		if (rPoints.empty())
 		{
-			center += rPoints[i];
+			return false;
 		}
-		center /= (float)rPoints.size();
 
-		for (unsigned int i = 0; i < rPoints.size(); i++)
+		std::vector<Vector3F> points(rPoints);
+		std::mt19937 random(0);
+		std::shuffle(points.begin(), points.end(), random);
+
+		Vector3F sphereCenter = points[0];
+		float sphereRadius = 0;
+		for (unsigned int i = 1; i < points.size(); i++)
 		{
-			float distance = center.Distance(rPoints[i]);
-			if (distance > radius)
+			if (Contains(sphereCenter, sphereRadius, points[i]))
 			{
-				radius = distance;
+				continue;
 			}
+
+			// points[i] is on the boundary of the minimal sphere of points[0..i]
+			sphereCenter = points[i];
+			sphereRadius = 0;
+			for (unsigned int j = 0; j < i; j++)
+			{
+				if (Contains(sphereCenter, sphereRadius, points[j]))
+				{
+					continue;
+				}
+
+				Circumsphere(points[i], points[j], sphereCenter, sphereRadius);
+				for (unsigned int k = 0; k < j; k++)
+				{
+					if (Contains(sphereCenter, sphereRadius, points[k]))
+					{
+						continue;
+					}
+
+					Circumsphere(points[i], points[j], points[k], sphereCenter, sphereRadius);
+					for (unsigned int l = 0; l < k; l++)
+					{
+						if (Contains(sphereCenter, sphereRadius, points[l]))
+						{
+							continue;
+						}
+
+						Circumsphere(points[i], points[j], points[k], points[l], sphereCenter, sphereRadius);
+					}
+				}
+			}
+		}
+
+		// the circumspheres are computed with limited precision, the radius is made to enclose every point
+		center = sphereCenter;
+		for (unsigned int i = 0; i < rPoints.size(); i++)
+		{
+			radius = srt_max(radius, center.Distance(rPoints[i]));
 		}
 
 		return true;
 	}
 
+	virtual std::unique_ptr<BoundingVolume> Clone() const
+	{
+		return std::unique_ptr<BoundingVolume>(new BoundingSphere(*this));
+	}
+
 	virtual bool Intersect(const Ray& rRay) const
 	{
 		Vector3F viewerDirection = rRay.origin - mCurrentCenter;
 
-		float a = rRay.direction.Dot(rRay.direction);
+		float a = rRay.directionDot;
 		float b = 2.0f * rRay.direction.Dot(viewerDirection);
 		float c = viewerDirection.Dot(viewerDirection) - (mCurrentRadius * mCurrentRadius);
 
@@ -55,15 +111,13 @@ public:
 			return false;
 		}
 
-		float a2 = a * 2.0f;
+		// the ray enters the sphere at t1 and leaves it at t2, the interval of the ray must overlap that
 		float sqrtDelta = sqrt(delta);
+		float inverseA2 = 0.5f / a;
+		float t1 = (-b - sqrtDelta) * inverseA2;
+		float t2 = (-b + sqrtDelta) * inverseA2;
 
-		float t1 = (-b - sqrtDelta) / a2;
-		float t2 = (-b + sqrtDelta) / a2;
-
-		float t = (t1 < t2) ? t1 : t2;
-
-		return (t > 0);
+		return (t2 > rRay.tMin && t1 <= rRay.tMax);
 	}
 
 	virtual void Update(Transform transform)
@@ -82,10 +136,75 @@ public:
 		return mCurrentRadius;
 	}
 
+	virtual float SurfaceArea() const
+	{
+		return 4.0f * srt_PI * radius * radius;
+	}
+
 private:
 	Vector3F mCurrentCenter;
 	float mCurrentRadius;
 
+	static inline bool Contains(const Vector3F& rCenter, float radius, const Vector3F& rPoint)
+	{
+		return rCenter.Distance(rPoint) <= radius * 1.00001f;
+	}
+
+	static void Circumsphere(const Vector3F& rA, const Vector3F& rB, Vector3F& rCenter, float& rRadius)
+	{
+		rCenter = (rA + rB) * 0.5f;
+		rRadius = rA.Distance(rB) * 0.5f;
+	}
+
+	static void Circumsphere(const Vector3F& rA, const Vector3F& rB, const Vector3F& rC, Vector3F& rCenter, float& rRadius)
+	{
+		Vector3F ab = rB - rA;
+		Vector3F ac = rC - rA;
+		Vector3F normal = ab.Cross(ac);
+		float denominator = 2.0f * normal.Dot(normal);
+		if (denominator <= FLT_EPSILON * ab.Dot(ab) * ac.Dot(ac))
+		{
+			// collinear: the sphere around the two farthest points
+			float abLength = ab.Length(), acLength = ac.Length(), bcLength = rB.Distance(rC);
+			if (abLength >= acLength && abLength >= bcLength)
+			{
+				Circumsphere(rA, rB, rCenter, rRadius);
+			}
+			else if (acLength >= bcLength)
+			{
+				Circumsphere(rA, rC, rCenter, rRadius);
+			}
+			else
+			{
+				Circumsphere(rB, rC, rCenter, rRadius);
+			}
+			return;
+		}
+
+		Vector3F offset = (normal.Cross(ab) * ac.Dot(ac) + ac.Cross(normal) * ab.Dot(ab)) / denominator;
+		rCenter = rA + offset;
+		rRadius = offset.Length();
+	}
+
+	static void Circumsphere(const Vector3F& rA, const Vector3F& rB, const Vector3F& rC, const Vector3F& rD, Vector3F& rCenter, float& rRadius)
+	{
+		Vector3F ab = rB - rA;
+		Vector3F ac = rC - rA;
+		Vector3F ad = rD - rA;
+		float denominator = 2.0f * ab.Dot(ac.Cross(ad));
+		if (fabs(denominator) <= FLT_EPSILON * ab.Length() * ac.Length() * ad.Length())
+		{
+			// coplanar: grow the sphere of the first three to reach the fourth
+			Circumsphere(rA, rB, rC, rCenter, rRadius);
+			rRadius = srt_max(rRadius, rCenter.Distance(rD));
+			return;
+		}
+
+		Vector3F offset = (ac.Cross(ad) * ab.Dot(ab) + ad.Cross(ab) * ac.Dot(ac) + ab.Cross(ac) * ad.Dot(ad)) / denominator;
+		rCenter = rA + offset;
+		rRadius = offset.Length();
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -2,22 +2,98 @@
 #define BOUNDINGVOLUME_H_
 
 #include <vector>
+#include <memory>
 
 #include "Ray.h"
 #include "Vector3F.h"
+#include "Matrix3x3F.h"
 #include "Transform.h"
 
+enum BoundingVolumeType
+{
+	BVT_NONE, BVT_AUTO, BVT_SPHERE, BVT_AABB, BVT_OBB, BVT_KDOP
+};
+
+// conservative volume around an object space point set, used to cull rays before the mesh itself is intersected
 struct BoundingVolume
 {
 	virtual ~BoundingVolume() = default;
 
 	virtual bool Compute(const std::vector<Vector3F>& rPoints) = 0;
+	// copy of the computed volume, so that every instance of the same points places it with its own transform
+	virtual std::unique_ptr<BoundingVolume> Clone() const = 0;
+	// true if the ray enters the volume inside [rRay.tMin, rRay.tMax], including rays starting inside it.
+	// volumes beyond the closest hit found so far are culled this way
 	virtual bool Intersect(const Ray& rRay) const = 0;
 	virtual void Update(Transform transform) = 0;
+	// object space surface area, proportional to the chance of a random ray hitting the volume
+	virtual float SurfaceArea() const = 0;
 
 protected:
+	// volumes bounded by planes are tested in the space they were computed in.
+	// the transform is affine, so the ray parameter is the same in both spaces
+	Matrix3F mInverseModel;
+	Vector3F mPosition;
+	// see ReciprocalScale
+	Vector3F mInverseModelScale;
+
 	BoundingVolume() = default;
 
+	inline void SetModel(const Transform& rTransform)
+	{
+		mInverseModel = (rTransform.rotation * rTransform.scale).Inverse();
+		mPosition = rTransform.position;
+		mInverseModelScale = ReciprocalScale(mInverseModel);
+	}
+
+	inline Ray ToObjectSpace(const Ray& rRay) const
+	{
+		return ToVolumeSpace(rRay, mInverseModel, mInverseModelScale);
+	}
+
+	// brings a world space ray into the space rMatrix maps (rRay.origin - mPosition) to
+	inline Ray ToVolumeSpace(const Ray& rRay, const Matrix3F& rMatrix, const Vector3F& rScale) const
+	{
+		Vector3F direction = rMatrix * rRay.direction;
+		// a matrix that only scales carries the reciprocals of the ray over, so they aren't divided for again
+		Vector3F inverseDirection = (rScale.x() != 0) ? rRay.inverseDirection * rScale : Vector3F(1.0f / direction.x(), 1.0f / direction.y(), 1.0f / direction.z());
+		return Ray(rMatrix * (rRay.origin - mPosition), direction, inverseDirection, rRay.tMin, rRay.tMax);
+	}
+
+	// reciprocals of the diagonal of a matrix without rotation (e.g., the one of an instance that is only scaled),
+	// 0 for the others
+	static inline Vector3F ReciprocalScale(const Matrix3F& rMatrix)
+	{
+		if (rMatrix[0][1] != 0 || rMatrix[0][2] != 0 || rMatrix[1][0] != 0 || rMatrix[1][2] != 0 || rMatrix[2][0] != 0 || rMatrix[2][1] != 0)
+		{
+			return Vector3F(0, 0, 0);
+		}
+		return Vector3F(1.0f / rMatrix[0][0], 1.0f / rMatrix[1][1], 1.0f / rMatrix[2][2]);
+	}
+
+	// clips the ray parameter range [rT0, rT1] against the slab minimum <= origin + t * direction <= maximum.
+	// inverseDirection is 1 / direction, which callers usually have already
+	static inline bool ClipToSlab(float origin, float direction, float inverseDirection, float minimum, float maximum, float& rT0, float& rT1)
+	{
+		if (direction == 0)
+		{
+			return origin >= minimum && origin <= maximum;
+		}
+
+		float tNear = (minimum - origin) * inverseDirection;
+		float tFar = (maximum - origin) * inverseDirection;
+		if (tNear > tFar)
+		{
+			float tmp = tNear;
+			tNear = tFar;
+			tFar = tmp;
+		}
+
+		rT0 = srt_max(rT0, tNear);
+		rT1 = srt_min(rT1, tFar);
+		return rT0 <= rT1;
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -8,7 +8,7 @@ EigenSolver::EigenSolver(const Matrix3F& rMatrix)
 {
 	mIsRotation = false;
 
-	mMatrix[0][0] = rMatrix[0][1]; mMatrix[0][1] = rMatrix[0][1]; mMatrix[0][2] = rMatrix[0][2];
+	mMatrix[0][0] = rMatrix[0][0]; mMatrix[0][1] = rMatrix[0][1]; mMatrix[0][2] = rMatrix[0][2];
 	mMatrix[1][0] = rMatrix[1][0]; mMatrix[1][1] = rMatrix[1][1]; mMatrix[1][2] = rMatrix[1][2];
 	mMatrix[2][0] = rMatrix[2][0]; mMatrix[2][1] = rMatrix[2][1]; mMatrix[2][2] = rMatrix[2][2];
 }
@@ -0,0 +1,30 @@
+#ifndef HITATTRIBUTES_H_
+#define HITATTRIBUTES_H_
+
+#include "Vector3F.h"
+#include "Vector2F.h"
+
+struct HitAttributes
+{
+	Vector3F point;
+	Vector3F normal;
+	// only evaluated for textured materials
+	Vector2F uv;
+
+	HitAttributes()
+	{
+	}
+
+	HitAttributes(const Vector3F& point, const Vector3F& normal)
+	{
+		this->point = point;
+		this->normal = normal;
+	}
+
+	~HitAttributes()
+	{
+	}
+
+};
+
+#endif
\ No newline at end of file
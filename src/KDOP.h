@@ -0,0 +1,213 @@
+#ifndef KDOP_H_
+#define KDOP_H_
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "Common.h"
+#include "BoundingVolume.h"
+
+// 18-DOP: the intersection of 9 slabs, the 3 coordinate axes plus the 6 edge diagonals of the unit cube.
+// bevels the corners and edges an axis aligned box leaves empty
+struct KDOP : public BoundingVolume
+{
+	static const unsigned int NUMBER_OF_AXES = 9;
+
+	float minValues[NUMBER_OF_AXES];
+	float maxValues[NUMBER_OF_AXES];
+
+	KDOP()
+	{
+		for (unsigned int i = 0; i < NUMBER_OF_AXES; i++)
+		{
+			minValues[i] = maxValues[i] = 0;
+		}
+	}
+
+	virtual ~KDOP()
+	{
+	}
+
+	virtual bool Compute(const std::vector<Vector3F>& rPoints)
+	{
+		if (rPoints.empty())
+		{
+			return false;
+		}
+
+		for (unsigned int i = 0; i < NUMBER_OF_AXES; i++)
+		{
+			minValues[i] = FLT_MAX;
+			maxValues[i] = -FLT_MAX;
+		}
+
+		for (unsigned int i = 0; i < rPoints.size(); i++)
+		{
+			for (unsigned int j = 0; j < NUMBER_OF_AXES; j++)
+			{
+				float distance = Axis(j).Dot(rPoints[i]);
+				minValues[j] = srt_min(minValues[j], distance);
+				maxValues[j] = srt_max(maxValues[j], distance);
+			}
+		}
+
+		return true;
+	}
+
+	virtual std::unique_ptr<BoundingVolume> Clone() const
+	{
+		return std::unique_ptr<BoundingVolume>(new KDOP(*this));
+	}
+
+	virtual bool Intersect(const Ray& rRay) const
+	{
+		float t0 = rRay.tMin;
+		float t1 = rRay.tMax;
+
+		// the coordinate slabs take the reciprocals of the object space ray
+		Ray ray = ToObjectSpace(rRay);
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			if (!ClipToSlab(ray.origin[i], ray.direction[i], ray.inverseDirection[i], minValues[i], maxValues[i], t0, t1))
+			{
+				return false;
+			}
+		}
+
+		// the diagonals are only divided for once the ray gets through the box of the first 3 slabs
+		for (unsigned int i = 3; i < NUMBER_OF_AXES; i++)
+		{
+			Vector3F axis = Axis(i);
+			float direction = axis.Dot(ray.direction);
+			if (!ClipToSlab(axis.Dot(ray.origin), direction, 1.0f / direction, minValues[i], maxValues[i], t0, t1))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	virtual void Update(Transform transform)
+	{
+		SetModel(transform);
+	}
+
+	// sum of the face areas of the polytope, built by cutting the box of the first 3 slabs with the other 12 planes
+	virtual float SurfaceArea() const
+	{
+		std::vector<std::vector<Vector3F> > faces;
+		Vector3F minimum(minValues[0], minValues[1], minValues[2]);
+		Vector3F maximum(maxValues[0], maxValues[1], maxValues[2]);
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			unsigned int u = (i + 1) % 3, v = (i + 2) % 3;
+			for (unsigned int side = 0; side < 2; side++)
+			{
+				std::vector<Vector3F> face(4);
+				for (unsigned int j = 0; j < 4; j++)
+				{
+					face[j][i] = (side == 0) ? minimum[i] : maximum[i];
+					face[j][u] = (j == 1 || j == 2) ? maximum[u] : minimum[u];
+					face[j][v] = (j >= 2) ? maximum[v] : minimum[v];
+				}
+				faces.push_back(face);
+			}
+		}
+
+		for (unsigned int i = 3; i < NUMBER_OF_AXES; i++)
+		{
+			Vector3F axis = Axis(i);
+			CutPolytope(faces, axis, maxValues[i]);
+			CutPolytope(faces, -axis, -minValues[i]);
+		}
+
+		float area = 0;
+		for (auto& rFace : faces)
+		{
+			area += PolygonArea(rFace);
+		}
+		return area;
+	}
+
+private:
+	static inline Vector3F Axis(unsigned int i)
+	{
+		static const float AXES[NUMBER_OF_AXES][3] = {
+			{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },
+			{ 1, 1, 0 }, { 1, -1, 0 }, { 1, 0, 1 }, { 1, 0, -1 }, { 0, 1, 1 }, { 0, 1, -1 }
+		};
+		return Vector3F(AXES[i][0], AXES[i][1], AXES[i][2]);
+	}
+
+	// keeps the part of a convex polytope (given by its faces) where normal . x <= distance, closing the cut with a new face
+	static void CutPolytope(std::vector<std::vector<Vector3F> >& rFaces, const Vector3F& rNormal, float distance)
+	{
+		std::vector<Vector3F> cap;
+		std::vector<std::vector<Vector3F> > faces;
+		for (auto& rFace : rFaces)
+		{
+			std::vector<Vector3F> face;
+			for (unsigned int i = 0; i < rFace.size(); i++)
+			{
+				const Vector3F& rStart = rFace[i];
+				const Vector3F& rEnd = rFace[(i + 1) % rFace.size()];
+				float startDistance = rNormal.Dot(rStart) - distance;
+				float endDistance = rNormal.Dot(rEnd) - distance;
+				if (startDistance <= 0)
+				{
+					face.push_back(rStart);
+					if (startDistance == 0)
+					{
+						cap.push_back(rStart);
+					}
+				}
+				if ((startDistance < 0 && endDistance > 0) || (startDistance > 0 && endDistance < 0))
+				{
+					Vector3F crossing = rStart + (rEnd - rStart) * (startDistance / (startDistance - endDistance));
+					face.push_back(crossing);
+					cap.push_back(crossing);
+				}
+			}
+			if (face.size() >= 3)
+			{
+				faces.push_back(face);
+			}
+		}
+
+		if (cap.size() >= 3)
+		{
+			// the crossings are sorted by angle around their centroid
+			Vector3F centroid;
+			for (auto& rPoint : cap)
+			{
+				centroid += rPoint;
+			}
+			centroid /= (float)cap.size();
+			Vector3F u = (cap[0] - centroid).Normalized();
+			Vector3F v = rNormal.Cross(u).Normalized();
+			std::sort(cap.begin(), cap.end(), [&](const Vector3F& rA, const Vector3F& rB)
+			{
+				return atan2((rA - centroid).Dot(v), (rA - centroid).Dot(u)) < atan2((rB - centroid).Dot(v), (rB - centroid).Dot(u));
+			});
+			faces.push_back(cap);
+		}
+
+		rFaces.swap(faces);
+	}
+
+	static float PolygonArea(const std::vector<Vector3F>& rPolygon)
+	{
+		Vector3F sum;
+		for (unsigned int i = 1; i + 1 < rPolygon.size(); i++)
+		{
+			sum += (rPolygon[i] - rPolygon[0]).Cross(rPolygon[i + 1] - rPolygon[0]);
+		}
+		return 0.5f * sum.Length();
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+
+#include "KdTree.h"
+
+const float KdTree::SAH_TRAVERSAL_COST = 1.0f;
+const float KdTree::SAH_INTERSECTION_COST = 80.0f;
+const float KdTree::SAH_EMPTY_BONUS = 0.5f;
+
+//////////////////////////////////////////////////////////////////////////
+KdTree::KdTree() :
+	mMaxDepth(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+void KdTree::Update(const std::vector<AABB>& rPrimitiveBounds)
+{
+	if (!mNodes.empty() && rPrimitiveBounds == mPrimitiveBounds)
+	{
+		return;
+	}
+
+	Build(rPrimitiveBounds);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void KdTree::Clear()
+{
+	mBounds = AABB();
+	mNodes.clear();
+	mPrimitiveIndices.clear();
+	mPrimitiveBounds.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+size_t KdTree::GetMemory() const
+{
+	return mNodes.size() * sizeof(KdTreeNode) + mPrimitiveIndices.size() * sizeof(unsigned int) + mPrimitiveBounds.size() * sizeof(AABB);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void KdTree::Build(const std::vector<AABB>& rPrimitiveBounds)
+{
+	Clear();
+
+	mPrimitiveBounds = rPrimitiveBounds;
+
+	std::vector<unsigned int> primitives;
+	for (unsigned int i = 0; i < rPrimitiveBounds.size(); i++)
+	{
+		if (!rPrimitiveBounds[i].IsEmpty())
+		{
+			mBounds.Expand(rPrimitiveBounds[i]);
+			primitives.push_back(i);
+		}
+	}
+
+	if (primitives.empty())
+	{
+		return;
+	}
+
+	unsigned int maxDepth = static_cast<unsigned int>(8 + 1.3f * std::log2(static_cast<float>(primitives.size())) + 0.5f);
+	mMaxDepth = srt_min(maxDepth, MAX_DEPTH);
+	BuildRecursive(mBounds, primitives, 0, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void KdTree::BuildRecursive(const AABB& rNodeBounds, std::vector<unsigned int>& rPrimitives, unsigned int depth, unsigned int badRefines)
+{
+	unsigned int nodeIndex = static_cast<unsigned int>(mNodes.size());
+	mNodes.emplace_back();
+
+	unsigned int count = static_cast<unsigned int>(rPrimitives.size());
+	if (count <= 1 || depth >= mMaxDepth)
+	{
+		mNodes[nodeIndex].offset = static_cast<unsigned int>(mPrimitiveIndices.size());
+		mNodes[nodeIndex].count = count;
+		mPrimitiveIndices.insert(mPrimitiveIndices.end(), rPrimitives.begin(), rPrimitives.end());
+		return;
+	}
+
+	// sweep over the sorted bound planes of every axis. a primitive goes below the split if it starts
+	// at or before it and above if it ends at or after it, so events at the same position are
+	// counted as: starts first, cost evaluation, then ends
+	struct Event
+	{
+		float position;
+		bool start;
+	};
+	std::vector<Event> events(2 * count);
+
+	float nodeArea = rNodeBounds.SurfaceArea();
+	float inverseNodeArea = (nodeArea > 0) ? 1.0f / nodeArea : 0;
+	Vector3F nodeExtent = rNodeBounds.Extent();
+
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 3;
+	float bestSplit = 0;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		if (nodeExtent[axis] <= 0)
+		{
+			continue;
+		}
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const AABB& rBounds = mPrimitiveBounds[rPrimitives[i]];
+			events[2 * i].position = rBounds.minimum[axis];
+			events[2 * i].start = true;
+			events[2 * i + 1].position = rBounds.maximum[axis];
+			events[2 * i + 1].start = false;
+		}
+		std::sort(events.begin(), events.end(), [](const Event& rA, const Event& rB)
+		{
+			return (rA.position == rB.position) ? (rA.start && !rB.start) : (rA.position < rB.position);
+		});
+
+		unsigned int otherAxis0 = (axis + 1) % 3;
+		unsigned int otherAxis1 = (axis + 2) % 3;
+		unsigned int below = 0;
+		unsigned int above = count;
+		for (unsigned int i = 0; i < events.size();)
+		{
+			float position = events[i].position;
+			unsigned int j = i;
+			for (; j < events.size() && events[j].position == position && events[j].start; j++)
+			{
+				below++;
+			}
+
+			if (position > rNodeBounds.minimum[axis] && position < rNodeBounds.maximum[axis])
+			{
+				float belowExtent = position - rNodeBounds.minimum[axis];
+				float aboveExtent = rNodeBounds.maximum[axis] - position;
+				float sideArea = nodeExtent[otherAxis0] * nodeExtent[otherAxis1];
+				float perimeter = nodeExtent[otherAxis0] + nodeExtent[otherAxis1];
+				float belowProbability = 2.0f * (sideArea + belowExtent * perimeter) * inverseNodeArea;
+				float aboveProbability = 2.0f * (sideArea + aboveExtent * perimeter) * inverseNodeArea;
+				float emptyBonus = (below == 0 || above == 0) ? SAH_EMPTY_BONUS : 0;
+				float cost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * (1 - emptyBonus) * (belowProbability * below + aboveProbability * above);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = position;
+				}
+			}
+
+			for (; j < events.size() && events[j].position == position; j++)
+			{
+				above--;
+			}
+			i = j;
+		}
+	}
+
+	float leafCost = SAH_INTERSECTION_COST * count;
+	if (bestCost > leafCost)
+	{
+		badRefines++;
+	}
+
+	if (bestAxis == 3 || (bestCost > 4 * leafCost && count < 16) || badRefines == 3)
+	{
+		mNodes[nodeIndex].offset = static_cast<unsigned int>(mPrimitiveIndices.size());
+		mNodes[nodeIndex].count = count;
+		mPrimitiveIndices.insert(mPrimitiveIndices.end(), rPrimitives.begin(), rPrimitives.end());
+		return;
+	}
+
+	std::vector<unsigned int> belowPrimitives;
+	std::vector<unsigned int> abovePrimitives;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const AABB& rBounds = mPrimitiveBounds[rPrimitives[i]];
+		if (rBounds.minimum[bestAxis] <= bestSplit)
+		{
+			belowPrimitives.push_back(rPrimitives[i]);
+		}
+		if (rBounds.maximum[bestAxis] >= bestSplit)
+		{
+			abovePrimitives.push_back(rPrimitives[i]);
+		}
+	}
+	rPrimitives.clear();
+	rPrimitives.shrink_to_fit();
+
+	AABB belowBounds = rNodeBounds;
+	belowBounds.maximum[bestAxis] = bestSplit;
+	AABB aboveBounds = rNodeBounds;
+	aboveBounds.minimum[bestAxis] = bestSplit;
+
+	BuildRecursive(belowBounds, belowPrimitives, depth + 1, badRefines);
+	unsigned int aboveChild = static_cast<unsigned int>(mNodes.size());
+	BuildRecursive(aboveBounds, abovePrimitives, depth + 1, badRefines);
+
+	mNodes[nodeIndex].split = bestSplit;
+	mNodes[nodeIndex].axis = bestAxis;
+	mNodes[nodeIndex].offset = aboveChild;
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool KdTree::Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const
+{
+	if (mNodes.empty())
+	{
+		return false;
+	}
+
+	float tMin, tMax;
+	if (!mBounds.Intersect(rRay, tMin, tMax))
+	{
+		return false;
+	}
+
+	// front to back: the far child is deferred with the ray segment that lies behind the split plane
+	struct StackEntry
+	{
+		unsigned int node;
+		float tMin;
+		float tMax;
+	} stack[MAX_DEPTH + 1];
+	unsigned int stackSize = 0;
+
+	bool hit = false;
+	unsigned int node = 0;
+	while (true)
+	{
+		// primitives span several nodes, so a hit only ends the traversal once the next node starts beyond it
+		if (rRay.tMax < tMin)
+		{
+			break;
+		}
+
+		const KdTreeNode& rNode = mNodes[node];
+		if (!rNode.IsLeaf())
+		{
+			unsigned int axis = rNode.axis;
+			float tPlane = (rNode.split - rRay.origin[axis]) * rRay.inverseDirection[axis];
+			bool belowFirst = (rRay.origin[axis] < rNode.split) || (rRay.origin[axis] == rNode.split && rRay.direction[axis] <= 0);
+			unsigned int first = (belowFirst) ? node + 1 : rNode.offset;
+			unsigned int second = (belowFirst) ? rNode.offset : node + 1;
+
+			// NaN: the ray runs inside the split plane, where every primitive it can hit is referenced by both children
+			if (tPlane > tMax || tPlane <= 0 || tPlane != tPlane)
+			{
+				node = first;
+			}
+			else if (tPlane < tMin)
+			{
+				node = second;
+			}
+			else
+			{
+				stack[stackSize].node = second;
+				stack[stackSize].tMin = tPlane;
+				stack[stackSize++].tMax = tMax;
+				node = first;
+				tMax = tPlane;
+			}
+			continue;
+		}
+
+		for (unsigned int i = rNode.offset; i < rNode.offset + rNode.count; i++)
+		{
+			if (intersectPrimitive(pContext, mPrimitiveIndices[i]))
+			{
+				hit = true;
+				if (anyHit)
+				{
+					return true;
+				}
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			break;
+		}
+		stackSize--;
+		node = stack[stackSize].node;
+		tMin = stack[stackSize].tMin;
+		tMax = stack[stackSize].tMax;
+	}
+
+	return hit;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef KDTREE_H_
+#define KDTREE_H_
+
+#include <vector>
+
+#include "Accelerator.h"
+#include "AABB.h"
+#include "Ray.h"
+
+struct KdTreeNode
+{
+	float split;
+	// 0-2: split axis of an interior node, 3: leaf
+	unsigned int axis;
+	// leaf: index of the first primitive reference, interior: index of the child above the split plane (the one below is always the next node)
+	unsigned int offset;
+	// number of primitive references of a leaf
+	unsigned int count;
+
+	KdTreeNode() :
+		split(0),
+		axis(3),
+		offset(0),
+		count(0)
+	{
+	}
+
+	inline bool IsLeaf() const
+	{
+		return axis == 3;
+	}
+
+};
+
+// axis aligned binary space partition with split planes chosen by the surface area heuristic.
+// primitives straddling a split plane are referenced by both sides
+class KdTree : public Accelerator
+{
+public:
+	KdTree();
+	virtual ~KdTree() = default;
+
+	virtual void Update(const std::vector<AABB>& rPrimitiveBounds);
+	virtual void Clear();
+	virtual size_t GetMemory() const;
+	virtual bool Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const;
+
+	void Build(const std::vector<AABB>& rPrimitiveBounds);
+
+	inline unsigned int NumberOfNodes() const
+	{
+		return static_cast<unsigned int>(mNodes.size());
+	}
+
+private:
+	static const unsigned int MAX_DEPTH = 63;
+	static const float SAH_TRAVERSAL_COST;
+	static const float SAH_INTERSECTION_COST;
+	static const float SAH_EMPTY_BONUS;
+
+	AABB mBounds;
+	unsigned int mMaxDepth;
+	std::vector<KdTreeNode> mNodes;
+	std::vector<unsigned int> mPrimitiveIndices;
+	// bounds the tree was built with, the tree is only rebuilt when they change
+	std::vector<AABB> mPrimitiveBounds;
+
+	void BuildRecursive(const AABB& rNodeBounds, std::vector<unsigned int>& rPrimitives, unsigned int depth, unsigned int badRefines);
+
+};
+
+#endif
\ No newline at end of file
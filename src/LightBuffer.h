@@ -0,0 +1,260 @@
+#ifndef LIGHTBUFFER_H_
+#define LIGHTBUFFER_H_
+
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <stdexcept>
+#include <xmmintrin.h>
+
+#include "Light.h"
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "ColorRGBA.h"
+#include "Vector3F.h"
+
+enum LightType
+{
+	LT_DIRECTIONAL, LT_POINT, LT_COUNT
+};
+
+// scene lights in structure of arrays form, one set of arrays per light type. it's compiled once per frame,
+// so shading neither casts lights to their type nor gathers their fields from scattered objects
+struct LightBuffer
+{
+	struct Arrays
+	{
+		// directional lights: direction towards the light, point lights: position
+		std::vector<float> x, y, z;
+		// point lights only
+		std::vector<float> attenuation;
+		// light colors premultiplied by the light intensity, one array per channel
+		std::vector<float> diffuse[4];
+		std::vector<float> specular[4];
+
+		void Clear()
+		{
+			x.clear(); y.clear(); z.clear();
+			attenuation.clear();
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				diffuse[c].clear();
+				specular[c].clear();
+			}
+		}
+
+		unsigned int Add(const Light& rLight, const Vector3F& rVector, float lightAttenuation)
+		{
+			x.push_back(rVector.x()); y.push_back(rVector.y()); z.push_back(rVector.z());
+			attenuation.push_back(lightAttenuation);
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				diffuse[c].push_back(rLight.intensity * rLight.diffuseColor[c]);
+				specular[c].push_back(rLight.intensity * rLight.specularColor[c]);
+			}
+			return static_cast<unsigned int>(x.size() - 1);
+		}
+
+	};
+
+	Arrays lights[LT_COUNT];
+	// type and slot (index in the arrays of its type) of every scene light
+	std::vector<LightType> types;
+	std::vector<unsigned int> slots;
+
+	// number of lights shaded at once by LightAccumulator
+	static const unsigned int LANES = 4;
+
+	LightBuffer() = default;
+	~LightBuffer() = default;
+
+	void Build(const std::vector<std::unique_ptr<Light>>& rLights)
+	{
+		for (unsigned int i = 0; i < LT_COUNT; i++)
+		{
+			lights[i].Clear();
+		}
+		types.resize(rLights.size());
+		slots.resize(rLights.size());
+
+		for (unsigned int i = 0; i < rLights.size(); i++)
+		{
+			const Light* pLight = rLights[i].get();
+			if (const DirectionalLight* pDirectionalLight = dynamic_cast<const DirectionalLight*>(pLight))
+			{
+				types[i] = LT_DIRECTIONAL;
+				slots[i] = lights[LT_DIRECTIONAL].Add(*pLight, -pDirectionalLight->direction, 0);
+			}
+			else if (const PointLight* pPointLight = dynamic_cast<const PointLight*>(pLight))
+			{
+				types[i] = LT_POINT;
+				slots[i] = lights[LT_POINT].Add(*pLight, pPointLight->position, pPointLight->attenuation);
+			}
+			else
+			{
+				throw std::runtime_error("unimplemented light type");
+			}
+		}
+	}
+
+	// -1 means the light is infinitely far away
+	inline void GetDirectionToLight(unsigned int light, const Vector3F& rPoint, Vector3F& rDirectionToLight, float& rDistanceToLight) const
+	{
+		const Arrays& rArrays = lights[types[light]];
+		unsigned int slot = slots[light];
+		if (types[light] == LT_DIRECTIONAL)
+		{
+			rDirectionToLight = Vector3F(rArrays.x[slot], rArrays.y[slot], rArrays.z[slot]);
+			rDistanceToLight = -1;
+		}
+		else
+		{
+			rDirectionToLight = Vector3F(rArrays.x[slot], rArrays.y[slot], rArrays.z[slot]) - rPoint;
+			rDistanceToLight = rDirectionToLight.Length();
+			rDirectionToLight /= rDistanceToLight;
+		}
+	}
+
+};
+
+// Blinn-Phong shading of a surface point, LANES lights of a type at a time. lights are added once they are known to be
+// unblocked and shaded as soon as a batch of their type fills up. the diffuse color must already include the material texture
+class LightAccumulator
+{
+public:
+	LightAccumulator(const LightBuffer& rLights, const Vector3F& rNormal, const Vector3F& rViewerDirection, const ColorRGBA& rDiffuseColor, const ColorRGBA& rSpecularColor, float shininess) :
+		mrLights(rLights),
+		mNormal(rNormal),
+		mViewerDirection(rViewerDirection),
+		mDiffuseColor(rDiffuseColor),
+		mSpecularColor(rSpecularColor),
+		mShininess(shininess)
+	{
+		for (unsigned int i = 0; i < LT_COUNT; i++)
+		{
+			mBatches[i].size = 0;
+		}
+	}
+
+	~LightAccumulator() = default;
+
+	inline void Add(unsigned int light, const Vector3F& rDirectionToLight, float distanceToLight)
+	{
+		LightType type = mrLights.types[light];
+		Batch& rBatch = mBatches[type];
+		unsigned int slot = mrLights.slots[light];
+		rBatch.slots[rBatch.size] = slot;
+		rBatch.directionx[rBatch.size] = rDirectionToLight.x();
+		rBatch.directiony[rBatch.size] = rDirectionToLight.y();
+		rBatch.directionz[rBatch.size] = rDirectionToLight.z();
+		rBatch.falloff[rBatch.size] = (type == LT_POINT) ? 1.0f / (mrLights.lights[LT_POINT].attenuation[slot] * distanceToLight) : 1.0f;
+		if (++rBatch.size == LightBuffer::LANES)
+		{
+			Shade(type);
+		}
+	}
+
+	// shades the lights still waiting in a batch and returns the sum of every light contribution
+	ColorRGBA Resolve()
+	{
+		for (unsigned int i = 0; i < LT_COUNT; i++)
+		{
+			Shade(static_cast<LightType>(i));
+		}
+		return mColor;
+	}
+
+private:
+	static const unsigned int LANES = LightBuffer::LANES;
+
+	struct Batch
+	{
+		unsigned int size;
+		unsigned int slots[LANES];
+		float directionx[LANES];
+		float directiony[LANES];
+		float directionz[LANES];
+		// distance attenuation, 1 for lights without one
+		float falloff[LANES];
+	};
+
+	const LightBuffer& mrLights;
+	Vector3F mNormal;
+	Vector3F mViewerDirection;
+	ColorRGBA mDiffuseColor;
+	ColorRGBA mSpecularColor;
+	float mShininess;
+	Batch mBatches[LT_COUNT];
+	ColorRGBA mColor;
+
+	// every operation is done in the same order as the scalar Blinn-Phong (Vector3F dot products and normalization,
+	// ColorRGBA products) so that the contributions agree with it to the bit
+	void Shade(LightType type)
+	{
+		Batch& rBatch = mBatches[type];
+		if (rBatch.size == 0)
+		{
+			return;
+		}
+
+		// unused lanes repeat the first light and are never added
+		for (unsigned int i = rBatch.size; i < LANES; i++)
+		{
+			rBatch.slots[i] = rBatch.slots[0];
+			rBatch.directionx[i] = rBatch.directionx[0];
+			rBatch.directiony[i] = rBatch.directiony[0];
+			rBatch.directionz[i] = rBatch.directionz[0];
+			rBatch.falloff[i] = 0;
+		}
+
+		__m128 lx = _mm_loadu_ps(rBatch.directionx), ly = _mm_loadu_ps(rBatch.directiony), lz = _mm_loadu_ps(rBatch.directionz);
+		__m128 nx = _mm_set1_ps(mNormal.x()), ny = _mm_set1_ps(mNormal.y()), nz = _mm_set1_ps(mNormal.z());
+		__m128 zero = _mm_setzero_ps();
+
+		// max(x, 0) of the scalar version also turns NaNs into 0, and so does _mm_max_ps with 0 as second operand
+		__m128 NdotL = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)), _mm_mul_ps(nz, lz)), zero);
+
+		// half vector
+		__m128 hx = _mm_add_ps(lx, _mm_set1_ps(mViewerDirection.x()));
+		__m128 hy = _mm_add_ps(ly, _mm_set1_ps(mViewerDirection.y()));
+		__m128 hz = _mm_add_ps(lz, _mm_set1_ps(mViewerDirection.z()));
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, hx), _mm_mul_ps(hy, hy)), _mm_mul_ps(hz, hz)));
+		hx = _mm_div_ps(hx, length);
+		hy = _mm_div_ps(hy, length);
+		hz = _mm_div_ps(hz, length);
+		__m128 NdotH = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, hx), _mm_mul_ps(ny, hy)), _mm_mul_ps(nz, hz)), zero);
+
+		// there's no vector pow, so the specular term is raised to the shininess lane by lane
+		float NdotLs[LANES], NdotHs[LANES], speculars[LANES];
+		_mm_storeu_ps(NdotLs, NdotL);
+		_mm_storeu_ps(NdotHs, NdotH);
+		for (unsigned int i = 0; i < LANES; i++)
+		{
+			speculars[i] = (NdotLs[i] > 0) ? pow(NdotHs[i], mShininess) : 0;
+		}
+		__m128 specular = _mm_loadu_ps(speculars);
+		__m128 falloff = _mm_loadu_ps(rBatch.falloff);
+
+		const LightBuffer::Arrays& rArrays = mrLights.lights[type];
+		const unsigned int* pSlots = rBatch.slots;
+		float contributions[4][LANES];
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			__m128 lightDiffuse = _mm_setr_ps(rArrays.diffuse[c][pSlots[0]], rArrays.diffuse[c][pSlots[1]], rArrays.diffuse[c][pSlots[2]], rArrays.diffuse[c][pSlots[3]]);
+			__m128 lightSpecular = _mm_setr_ps(rArrays.specular[c][pSlots[0]], rArrays.specular[c][pSlots[1]], rArrays.specular[c][pSlots[2]], rArrays.specular[c][pSlots[3]]);
+			__m128 diffuse = _mm_mul_ps(_mm_mul_ps(lightDiffuse, _mm_set1_ps(mDiffuseColor[c])), NdotL);
+			__m128 specularColor = _mm_mul_ps(_mm_mul_ps(lightSpecular, _mm_set1_ps(mSpecularColor[c])), specular);
+			_mm_storeu_ps(contributions[c], _mm_mul_ps(_mm_add_ps(diffuse, specularColor), falloff));
+		}
+
+		// contributions are summed up in the order the lights were added
+		for (unsigned int i = 0; i < rBatch.size; i++)
+		{
+			mColor += ColorRGBA(contributions[0][i], contributions[1][i], contributions[2][i], contributions[3][i]);
+		}
+		rBatch.size = 0;
+	}
+
+};
+
+#endif
\ No newline at end of file
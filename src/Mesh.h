@@ -4,158 +4,191 @@
 #include <vector>
 #include <string>
 #include <memory>
-#include <climits>
+#include <cfloat>
 
 #include "SceneObject.h"
+#include "MeshGeometry.h"
 #include "Vector2F.h"
 #include "BoundingVolume.h"
 
-#define srt_triangleIntersectEpsilon 0.000001f
-
+// instance of a (possibly shared) triangle set, placed in the world by its transform
 struct Mesh : public SceneObject
 {
 private:
-	std::vector<Vector3F> cachedVertices;
-	std::vector<Vector3F> cachedNormals;
+	Matrix3F cachedInverseModel;
+	bool cachedMirrored;
+	AABB cachedBounds;
+	// copy of the geometry's volume (pCachedBoundingVolumeSource) placed with this instance's transform
+	std::unique_ptr<BoundingVolume> cachedBoundingVolume;
+	const BoundingVolume* pCachedBoundingVolumeSource;
 
 public:
-	std::vector<Vector3F> vertices;
-	std::vector<Vector3F> normals;
-	std::vector<Vector2F> uvs;
-	std::vector<unsigned int> indices;
-	std::unique_ptr<BoundingVolume> boundingVolume;
+	std::shared_ptr<MeshGeometry> geometry;
+
+	Mesh() :
+		cachedMirrored(false),
+		pCachedBoundingVolumeSource(nullptr),
+		geometry(new MeshGeometry())
+	{
+	}
+
+	Mesh(const std::shared_ptr<MeshGeometry>& rGeometry) :
+		cachedMirrored(false),
+		pCachedBoundingVolumeSource(nullptr),
+		geometry(rGeometry)
+	{
+	}
 
-	Mesh() = default;
 	virtual ~Mesh() = default;
 
 	virtual void Update()
 	{
 		SceneObject::Update();
 
-		if (boundingVolume != 0)
-		{
-			boundingVolume->Update(mWorldTransform);
-		}
+		geometry->Update();
 
 		CreateCache();
 	}
 
 	void CreateCache()
 	{
-		cachedVertices.resize(vertices.size());
-		cachedNormals.resize(normals.size());
-		for (unsigned int i = 0; i < indices.size(); i += 3)
+		// the volume is computed once per geometry, instances only copy it when the geometry builds a new one
+		if (geometry->GetBoundingVolume() != pCachedBoundingVolumeSource)
+		{
+			pCachedBoundingVolumeSource = geometry->GetBoundingVolume();
+			cachedBoundingVolume = (pCachedBoundingVolumeSource != nullptr) ? pCachedBoundingVolumeSource->Clone() : nullptr;
+		}
+		if (cachedBoundingVolume != nullptr)
 		{
-			unsigned int i1 = indices[i];
-			unsigned int i2 = indices[i + 1];
-			unsigned int i3 = indices[i + 2];
+			cachedBoundingVolume->Update(mWorldTransform);
+		}
 
-			cachedVertices[i1] = mWorldTransform * vertices[i1];
-			cachedVertices[i2] = mWorldTransform * vertices[i2];
-			cachedVertices[i3] = mWorldTransform * vertices[i3];
+		Matrix3F model = mWorldTransform.rotation * mWorldTransform.scale;
+		cachedInverseModel = model.Inverse();
+		cachedMirrored = model.Determinant() < 0;
 
-			cachedNormals[i1] = mWorldTransform.rotation * normals[i1];
-			cachedNormals[i2] = mWorldTransform.rotation * normals[i2];
-			cachedNormals[i3] = mWorldTransform.rotation * normals[i3];
+		// world bounds of the object space box
+		const AABB& rBounds = geometry->GetBounds();
+		cachedBounds = AABB();
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			Vector3F corner((i & 1) ? rBounds.maximum.x() : rBounds.minimum.x(), (i & 2) ? rBounds.maximum.y() : rBounds.minimum.y(), (i & 4) ? rBounds.maximum.z() : rBounds.minimum.z());
+			cachedBounds.Expand(mWorldTransform * corner);
 		}
 	}
 
-	virtual bool Intersect(const Ray& rRay, RayHit& rHit) const
+	virtual AABB GetWorldBounds() const
+	{
+		return cachedBounds;
+	}
+
+	virtual bool Intersect(const Ray& rRay, RayHit& rHit, unsigned int ignoredPrimitive) const
 	{
-		if (boundingVolume != 0 && !boundingVolume->Intersect(rRay))
+		if (cachedBoundingVolume != nullptr && !cachedBoundingVolume->Intersect(rRay))
 		{
 			return false;
 		}
 
-		float t = FLT_MAX;
-		for (unsigned int i = 0; i < indices.size(); i += 3)
+		Ray ray = ToObjectSpace(rRay);
+		if (!geometry->Intersect(ray, cachedMirrored, ignoredPrimitive, rHit.primitive, rHit.u, rHit.v))
 		{
-			unsigned int i1 = indices[i];
-			unsigned int i2 = indices[i + 1];
-			unsigned int i3 = indices[i + 2];
+			return false;
+		}
 
-			const Vector3F& v1 = cachedVertices[i1];
-			const Vector3F& v2 = cachedVertices[i2];
-			const Vector3F& v3 = cachedVertices[i3];
+		rRay.tMax = ray.tMax;
+		rHit.t = ray.tMax;
 
-			float u, v, newT;
-			if (BackFaceCullTriangleIntersection(rRay, v1, v2, v3, u, v, newT) && newT < t)
+		return true;
+	}
+
+	virtual unsigned long long IntersectPacket(const RayPacket& rPacket, unsigned long long rayMask, RayHit* pHits) const
+	{
+		// only the rays in the mask are brought into object space, the others are never read
+		RayPacket objectSpacePacket;
+		objectSpacePacket.size = rPacket.size;
+		for (unsigned long long rays = rayMask; rays != 0; rays &= rays - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rays);
+			Ray ray = rPacket.GetRay(i);
+			if (cachedBoundingVolume != nullptr && !cachedBoundingVolume->Intersect(ray))
 			{
-				t = newT;
-				rHit.point = rRay.origin + t * rRay.direction;
-
-				float w = (1 - u - v);
-
-				if (normals.size() > 0)
-				{
-					const Vector3F& n1 = cachedNormals[i1];
-					const Vector3F& n2 = cachedNormals[i2];
-					const Vector3F& n3 = cachedNormals[i3];
-
-					rHit.normal = (w * n1 + u * n2 + v * n3).Normalized();
-				}
-				else
-				{
-					const Vector3F& rEdge1 = (v2 - v1);
-					const Vector3F& rEdge2 = (v3 - v1);
-
-					rHit.normal = rEdge1.Cross(rEdge2).Normalized();
-				}
-
-				if (uvs.size() > 0)
-				{
-					const Vector2F& rUV1 = uvs[i1];
-					const Vector2F& rUV2 = uvs[i2];
-					const Vector2F& rUV3 = uvs[i3];
-					rHit.uv = w * rUV1 + u * rUV2 + v * rUV3;
-				}
+				rayMask &= ~RayPacket::Bit(i);
+				continue;
 			}
+			objectSpacePacket.SetRay(i, ToObjectSpace(ray));
+		}
+
+		if (rayMask == 0)
+		{
+			return 0;
 		}
-		return t != FLT_MAX;
+
+		return geometry->IntersectPacket(objectSpacePacket, rayMask, cachedMirrored, pHits);
 	}
 
-private:
-	bool BackFaceCullTriangleIntersection(const Ray& rRay, const Vector3F& rP1, const Vector3F& rP2, const Vector3F& rP3, float& u, float& v, float& t) const
+	virtual void EvaluateAttributes(const Ray& rRay, const RayHit& rHit, HitAttributes& rAttributes) const
 	{
-		Vector3F rEdge1 = (rP2 - rP1);
-		Vector3F rEdge2 = (rP3 - rP1);
+		unsigned int i1 = geometry->indices[rHit.primitive * 3];
+		unsigned int i2 = geometry->indices[rHit.primitive * 3 + 1];
+		unsigned int i3 = geometry->indices[rHit.primitive * 3 + 2];
 
-		Vector3F rPVec = rRay.direction.Cross(rEdge2);
+		rAttributes.point = rRay.origin + rHit.t * rRay.direction;
 
-		float determinant = rEdge1.Dot(rPVec);
+		float u = rHit.u;
+		float v = rHit.v;
+		float w = (1 - u - v);
 
-		if (determinant < srt_triangleIntersectEpsilon)
+		if (geometry->normals.size() > 0)
 		{
-			return false;
+			const Vector3F& n1 = geometry->normals[i1];
+			const Vector3F& n2 = geometry->normals[i2];
+			const Vector3F& n3 = geometry->normals[i3];
+
+			rAttributes.normal = (mWorldTransform.rotation * (w * n1 + u * n2 + v * n3)).Normalized();
 		}
+		else
+		{
+			const Vector3F& v1 = geometry->vertices[i1];
+			const Vector3F& v2 = geometry->vertices[i2];
+			const Vector3F& v3 = geometry->vertices[i3];
 
-		Vector3F rTVec = (rRay.origin - rP1);
+			Vector3F rEdge1 = mWorldTransform.rotation * (mWorldTransform.scale * (v2 - v1));
+			Vector3F rEdge2 = mWorldTransform.rotation * (mWorldTransform.scale * (v3 - v1));
 
-		u = rTVec.Dot(rPVec);
+			rAttributes.normal = rEdge1.Cross(rEdge2).Normalized();
+		}
 
-		if (u < 0.0f || u > determinant)
+		if (material.texture != nullptr && geometry->uvs.size() > 0)
 		{
-			return false;
+			const Vector2F& rUV1 = geometry->uvs[i1];
+			const Vector2F& rUV2 = geometry->uvs[i2];
+			const Vector2F& rUV3 = geometry->uvs[i3];
+			rAttributes.uv = w * rUV1 + u * rUV2 + v * rUV3;
 		}
+	}
 
-		Vector3F rQVec = rTVec.Cross(rEdge1);
-
-		v = rRay.direction.Dot(rQVec);
-
-		if (v < 0.0f || u + v > determinant)
+	virtual bool Occluded(const Ray& rRay, unsigned int ignoredPrimitive, unsigned int& rPrimitive) const
+	{
+		if (cachedBoundingVolume != nullptr && !cachedBoundingVolume->Intersect(rRay))
 		{
 			return false;
 		}
 
-		t = rEdge2.Dot(rQVec);
-
-		float inverseDeterminant = 1.0f / determinant;
+		return geometry->Occluded(ToObjectSpace(rRay), cachedMirrored, ignoredPrimitive, rPrimitive);
+	}
 
-		u *= inverseDeterminant;
-		v *= inverseDeterminant;
-		t *= inverseDeterminant;
+	// a triangle hit is always inside the bounding volume, so it isn't tested
+	virtual bool PrimitiveOccluded(const Ray& rRay, unsigned int primitive) const
+	{
+		return geometry->TriangleOccluded(ToObjectSpace(rRay), cachedMirrored, primitive);
+	}
 
-		return true;
+private:
+	// the ray is brought into object space instead of keeping world space copies of the geometry.
+	// the transform is affine, so the ray parameter of a hit (and so the ray interval) is the same in both spaces
+	inline Ray ToObjectSpace(const Ray& rRay) const
+	{
+		return Ray(cachedInverseModel * (rRay.origin - mWorldTransform.position), cachedInverseModel * rRay.direction, rRay.tMin, rRay.tMax);
 	}
 
 };
@@ -0,0 +1,338 @@
+#ifndef MESHGEOMETRY_H_
+#define MESHGEOMETRY_H_
+
+#include <vector>
+#include <climits>
+#include <cfloat>
+#include <utility>
+#include <memory>
+
+#include "AABB.h"
+#include "BVH.h"
+#include "TriangleBuffer.h"
+#include "BoundingVolume.h"
+#include "BoundingSphere.h"
+#include "BoundingBox.h"
+#include "OBB.h"
+#include "KDOP.h"
+#include "Ray.h"
+#include "RayHit.h"
+#include "RayPacket.h"
+#include "Vector2F.h"
+#include "Vector3F.h"
+
+// triangle set in object space, shared by every mesh instance loaded from the same source
+struct MeshGeometry
+{
+private:
+	AABB cachedBounds;
+	BVH cachedBVH;
+	TriangleBuffer cachedTriangles;
+	std::unique_ptr<BoundingVolume> cachedBoundingVolume;
+	bool cacheValid;
+
+public:
+	std::vector<Vector3F> vertices;
+	std::vector<Vector3F> normals;
+	std::vector<Vector2F> uvs;
+	std::vector<unsigned int> indices;
+	BVHSettings bvhSettings;
+	BoundingVolumeType boundingVolumeType;
+
+	MeshGeometry() :
+		cacheValid(false),
+		boundingVolumeType(BVT_AUTO)
+	{
+	}
+
+	~MeshGeometry() = default;
+
+	inline unsigned int NumberOfTriangles() const
+	{
+		return static_cast<unsigned int>(indices.size() / 3);
+	}
+
+	inline const AABB& GetBounds() const
+	{
+		return cachedBounds;
+	}
+
+	inline const BVH& GetBVH() const
+	{
+		return cachedBVH;
+	}
+
+	inline const TriangleBuffer& GetTriangleBuffer() const
+	{
+		return cachedTriangles;
+	}
+
+	// object space volume the instances copy and place with their own transform, null if there is none
+	inline const BoundingVolume* GetBoundingVolume() const
+	{
+		return cachedBoundingVolume.get();
+	}
+
+	void Update()
+	{
+		if (!cacheValid)
+		{
+			CreateCache();
+		}
+	}
+
+	void ComputeTriangleBounds(std::vector<AABB>& rTriangleBounds) const
+	{
+		rTriangleBounds.resize(indices.size() / 3);
+		for (unsigned int i = 0; i < indices.size(); i += 3)
+		{
+			AABB& rBounds = rTriangleBounds[i / 3];
+			rBounds = AABB();
+			rBounds.Expand(vertices[indices[i]]);
+			rBounds.Expand(vertices[indices[i + 1]]);
+			rBounds.Expand(vertices[indices[i + 2]]);
+		}
+	}
+
+	// bounds of the part of a triangle between two planes perpendicular to an axis
+	AABB ClipTriangle(unsigned int triangle, unsigned int axis, float minimum, float maximum) const
+	{
+		AABB bounds;
+		const Vector3F* pVertices[3] = { &vertices[indices[triangle * 3]], &vertices[indices[triangle * 3 + 1]], &vertices[indices[triangle * 3 + 2]] };
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			const Vector3F& rStart = *pVertices[i];
+			if (rStart[axis] >= minimum && rStart[axis] <= maximum)
+			{
+				bounds.Expand(rStart);
+			}
+
+			// the edge is always walked from its lower end, so that both sides of a split plane get the exact same crossing point
+			const Vector3F* pA = pVertices[i];
+			const Vector3F* pB = pVertices[(i + 1) % 3];
+			if ((*pA)[axis] > (*pB)[axis])
+			{
+				std::swap(pA, pB);
+			}
+			const float planes[2] = { minimum, maximum };
+			for (float plane : planes)
+			{
+				if ((*pA)[axis] < plane && (*pB)[axis] > plane)
+				{
+					Vector3F crossing = *pA + (*pB - *pA) * ((plane - (*pA)[axis]) / ((*pB)[axis] - (*pA)[axis]));
+					crossing[axis] = plane;
+					bounds.Expand(crossing);
+				}
+			}
+		}
+		return bounds;
+	}
+
+	void CreateCache()
+	{
+		std::vector<AABB> triangleBounds;
+		ComputeTriangleBounds(triangleBounds);
+		cachedBounds = AABB();
+		for (auto& rTriangleBounds : triangleBounds)
+		{
+			cachedBounds.Expand(rTriangleBounds);
+		}
+
+		// vertices never change after loading, so the hierarchy is built once (instances move in world space around it)
+		cachedBVH.Build(triangleBounds, bvhSettings, [this](unsigned int triangle, unsigned int axis, float minimum, float maximum)
+		{
+			return ClipTriangle(triangle, axis, minimum, maximum);
+		});
+
+		// the triangles are laid out in leaf order so that intersecting a leaf streams through memory
+		cachedTriangles.Build(vertices, indices, cachedBVH.GetPrimitiveIndices());
+
+		cachedBoundingVolume = CreateBoundingVolume();
+
+		cacheValid = true;
+	}
+
+	std::unique_ptr<BoundingVolume> CreateBoundingVolume() const
+	{
+		std::vector<std::unique_ptr<BoundingVolume> > candidates;
+		if (boundingVolumeType == BVT_SPHERE || boundingVolumeType == BVT_AUTO)
+		{
+			candidates.emplace_back(new BoundingSphere());
+		}
+		if (boundingVolumeType == BVT_AABB || boundingVolumeType == BVT_AUTO)
+		{
+			candidates.emplace_back(new BoundingBox());
+		}
+		if (boundingVolumeType == BVT_OBB || boundingVolumeType == BVT_AUTO)
+		{
+			candidates.emplace_back(new OBB());
+		}
+		if (boundingVolumeType == BVT_KDOP || boundingVolumeType == BVT_AUTO)
+		{
+			candidates.emplace_back(new KDOP());
+		}
+
+		// the volume with the smallest surface area culls the most rays
+		std::unique_ptr<BoundingVolume> boundingVolume;
+		float smallestArea = FLT_MAX;
+		for (auto& rCandidate : candidates)
+		{
+			if (!rCandidate->Compute(vertices))
+			{
+				continue;
+			}
+
+			float area = rCandidate->SurfaceArea();
+			if (boundingVolume == nullptr || area < smallestArea)
+			{
+				smallestArea = area;
+				boundingVolume = std::move(rCandidate);
+			}
+		}
+		return boundingVolume;
+	}
+
+	// closest triangle but ignoredTriangle hit by an object space ray in (rRay.tMin, rRay.tMax], rRay.tMax is shrunk to it.
+	// mirrored instances see the triangles with reversed winding, so they cull the other side
+	bool Intersect(const Ray& rRay, bool mirrored, unsigned int ignoredTriangle, unsigned int& rTriangle, float& rU, float& rV) const
+	{
+		unsigned int closestTriangle = UINT_MAX;
+		cachedBVH.TraverseLeaves(rRay, [&](unsigned int first, unsigned int count)
+		{
+			bool hit = false;
+			for (unsigned int block = first; block < first + count; block += TriangleBuffer::LANES)
+			{
+				float ts[TriangleBuffer::LANES], us[TriangleBuffer::LANES], vs[TriangleBuffer::LANES];
+				unsigned int mask = cachedTriangles.Intersect8(rRay, block, srt_min(first + count - block, TriangleBuffer::LANES), mirrored, ts, us, vs);
+				for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					float newT = ts[lane];
+					if ((mask & 1) == 0 || !rRay.Contains(newT))
+					{
+						continue;
+					}
+
+					// ties go to the first triangle, as they would in a linear scan
+					unsigned int triangle = cachedTriangles.triangles[block + lane];
+					if (triangle == ignoredTriangle || (newT == rRay.tMax && triangle > closestTriangle))
+					{
+						continue;
+					}
+
+					rRay.tMax = newT;
+					closestTriangle = triangle;
+					rU = us[lane];
+					rV = vs[lane];
+					hit = true;
+				}
+			}
+			return hit;
+		});
+
+		if (closestTriangle == UINT_MAX)
+		{
+			return false;
+		}
+
+		rTriangle = closestTriangle;
+		return true;
+	}
+
+	// closest triangle hit by each ray of rayMask in an object space packet, in (0, rPacket.tMax].
+	// rPacket.tMax is shrunk as hits are found. returns the mask of the rays hit
+	unsigned long long IntersectPacket(RayPacket& rPacket, unsigned long long rayMask, bool mirrored, RayHit* pHits) const
+	{
+		unsigned int closestTriangles[RayPacket::MAX_SIZE];
+		for (unsigned long long rays = rayMask; rays != 0; rays &= rays - 1)
+		{
+			closestTriangles[RayPacket::FirstRay(rays)] = UINT_MAX;
+		}
+
+		cachedBVH.TraversePacket(rPacket, rayMask, [&](unsigned int first, unsigned int count, unsigned long long leafRayMask)
+		{
+			unsigned long long hits = 0;
+			for (; leafRayMask != 0; leafRayMask &= leafRayMask - 1)
+			{
+				unsigned int i = RayPacket::FirstRay(leafRayMask);
+				Ray ray = rPacket.GetRay(i);
+				for (unsigned int block = first; block < first + count; block += TriangleBuffer::LANES)
+				{
+					float ts[TriangleBuffer::LANES], us[TriangleBuffer::LANES], vs[TriangleBuffer::LANES];
+					unsigned int mask = cachedTriangles.Intersect8(ray, block, srt_min(first + count - block, TriangleBuffer::LANES), mirrored, ts, us, vs);
+					for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+					{
+						float newT = ts[lane];
+						if ((mask & 1) == 0 || newT <= 0 || newT > rPacket.tMax[i])
+						{
+							continue;
+						}
+
+						unsigned int triangle = cachedTriangles.triangles[block + lane];
+						if (newT == rPacket.tMax[i] && triangle > closestTriangles[i])
+						{
+							continue;
+						}
+
+						rPacket.tMax[i] = newT;
+						closestTriangles[i] = triangle;
+						pHits[i].t = newT;
+						pHits[i].primitive = triangle;
+						pHits[i].u = us[lane];
+						pHits[i].v = vs[lane];
+						hits |= RayPacket::Bit(i);
+					}
+				}
+			}
+			return hits;
+		});
+
+		unsigned long long hits = 0;
+		for (unsigned long long rays = rayMask; rays != 0; rays &= rays - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rays);
+			if (closestTriangles[i] != UINT_MAX)
+			{
+				hits |= RayPacket::Bit(i);
+			}
+		}
+		return hits;
+	}
+
+	// true if an object space ray hits any triangle but ignoredTriangle in (rRay.tMin, rRay.tMax), without looking for
+	// the closest one. rTriangle receives the triangle hit
+	bool Occluded(const Ray& rRay, bool mirrored, unsigned int ignoredTriangle, unsigned int& rTriangle) const
+	{
+		return cachedBVH.TraverseLeaves(rRay, [&](unsigned int first, unsigned int count)
+		{
+			for (unsigned int block = first; block < first + count; block += TriangleBuffer::LANES)
+			{
+				float ts[TriangleBuffer::LANES], us[TriangleBuffer::LANES], vs[TriangleBuffer::LANES];
+				unsigned int mask = cachedTriangles.Intersect8(rRay, block, srt_min(first + count - block, TriangleBuffer::LANES), mirrored, ts, us, vs);
+				for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if ((mask & 1) != 0 && ts[lane] > rRay.tMin && ts[lane] < rRay.tMax && cachedTriangles.triangles[block + lane] != ignoredTriangle)
+					{
+						rTriangle = cachedTriangles.triangles[block + lane];
+						return true;
+					}
+				}
+			}
+			return false;
+		}, true);
+	}
+
+	// same as Occluded, but only against one triangle
+	bool TriangleOccluded(const Ray& rRay, bool mirrored, unsigned int triangle) const
+	{
+		if (triangle >= cachedTriangles.slots.size())
+		{
+			return false;
+		}
+
+		float t, u, v;
+		return cachedTriangles.Intersect8(rRay, cachedTriangles.slots[triangle], 1, mirrored, &t, &u, &v) != 0 && t > rRay.tMin && t < rRay.tMax;
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -8,14 +8,14 @@
 #include <stdexcept>
 
 #include "Scene.h"
-#include "Mesh.h"
+#include "MeshGeometry.h"
 #include "TinyObjLoader.h"
 
 using namespace TinyObjLoader;
 
 struct ModelLoader
 {
-	static std::unique_ptr<Mesh> LoadObj(const std::string& fileName)
+	static std::shared_ptr<MeshGeometry> LoadObj(const std::string& fileName)
 	{
 		std::vector<shape_t> shapes;
 
@@ -25,7 +25,7 @@ struct ModelLoader
 			throw std::runtime_error("[TinyObjLoader] " + errorStr);
 		}
 
-		std::unique_ptr<Mesh> mesh(new Mesh());
+		std::shared_ptr<MeshGeometry> geometry(new MeshGeometry());
 		unsigned int offset = 0;
 		for (unsigned int i = 0; i < shapes.size(); i++)
 		{
@@ -35,28 +35,28 @@ struct ModelLoader
 
 			for (unsigned int j = 0; j < shape.mesh.indices.size(); j++)
 			{
-				mesh->indices.push_back(offset + shape.mesh.indices[j]);
+				geometry->indices.push_back(offset + shape.mesh.indices[j]);
 			}
 
 			for (unsigned int j = 0; j < shape.mesh.positions.size(); j += 3)
 			{
-				mesh->vertices.push_back(Vector3F(shape.mesh.positions[j], shape.mesh.positions[j + 1], shape.mesh.positions[j + 2]));
+				geometry->vertices.push_back(Vector3F(shape.mesh.positions[j], shape.mesh.positions[j + 1], shape.mesh.positions[j + 2]));
 			}
 
 			for (unsigned int j = 0; j < shape.mesh.normals.size(); j += 3)
 			{
-				mesh->normals.push_back(Vector3F(shape.mesh.normals[j], shape.mesh.normals[j + 1], shape.mesh.normals[j + 2]));
+				geometry->normals.push_back(Vector3F(shape.mesh.normals[j], shape.mesh.normals[j + 1], shape.mesh.normals[j + 2]));
 			}
 
 			for (unsigned int j = 0; j < shape.mesh.texcoords.size(); j += 2)
 			{
-				mesh->uvs.push_back(Vector2F(shape.mesh.texcoords[j], shape.mesh.texcoords[j + 1]));
+				geometry->uvs.push_back(Vector2F(shape.mesh.texcoords[j], shape.mesh.texcoords[j + 1]));
 			}
 
-			offset += static_cast<unsigned int>(mesh->vertices.size());
+			offset = static_cast<unsigned int>(geometry->vertices.size());
 		}
 
-		return mesh;
+		return geometry;
 	}
 
 private:
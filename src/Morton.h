@@ -0,0 +1,58 @@
+#ifndef MORTON_H_
+#define MORTON_H_
+
+#include "AABB.h"
+#include "Vector3F.h"
+
+// 30 bit morton (z-order) codes: points close in space get close codes, so sorting by them groups nearby points
+struct Morton
+{
+	static const unsigned int BITS_PER_AXIS = 10;
+
+	// interleaves the lower 10 bits of each coordinate
+	static inline unsigned int Encode(unsigned int x, unsigned int y, unsigned int z)
+	{
+		return (SpreadBits(x) << 2) | (SpreadBits(y) << 1) | SpreadBits(z);
+	}
+
+	// code of a point quantized to a 1024^3 lattice over rBounds
+	static inline unsigned int Encode(const Vector3F& rPoint, const AABB& rBounds)
+	{
+		const float scale = static_cast<float>((1 << BITS_PER_AXIS) - 1);
+		unsigned int coordinates[3];
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float extent = rBounds.maximum[axis] - rBounds.minimum[axis];
+			float normalized = (extent > 0) ? (rPoint[axis] - rBounds.minimum[axis]) / extent : 0;
+			coordinates[axis] = static_cast<unsigned int>((srt_clamp(normalized, 0.0f, 1.0f)) * scale);
+		}
+		return Encode(coordinates[0], coordinates[1], coordinates[2]);
+	}
+
+	// index of the highest bit set in a non-zero value. sorted codes that first differ at that bit
+	// are split in two by it, which is how linear BVHs are built
+	static inline unsigned int HighestBit(unsigned int value)
+	{
+		unsigned int bit = 0;
+		while ((value >>= 1) != 0)
+		{
+			bit++;
+		}
+		return bit;
+	}
+
+private:
+	// inserts two zero bits after each of the lower 10 bits
+	static inline unsigned int SpreadBits(unsigned int value)
+	{
+		value &= 0x3ff;
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+};
+
+#endif
\ No newline at end of file
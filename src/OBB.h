@@ -1,13 +1,15 @@
 #ifndef OBB_H_
 #define OBB_H_
 
+#include <cfloat>
+
+#include "AABB.h"
 #include "Common.h"
 #include "BoundingVolume.h"
 #include "Matrix3x3F.h"
 #include "EigenSolver.h"
 
-#define MAX_VALUE 100000.0f
-
+// box aligned to the principal axes of the point set
 struct OBB : public BoundingVolume
 {
 	Vector3F center;
@@ -15,12 +17,24 @@ struct OBB : public BoundingVolume
 	Vector3F maxValues;
 	Vector3F axis[3];
 
+	OBB()
+	{
+		axis[0] = Vector3F(1, 0, 0);
+		axis[1] = Vector3F(0, 1, 0);
+		axis[2] = Vector3F(0, 0, 1);
+	}
+
 	virtual ~OBB()
 	{
 	}
 
 	virtual bool Compute(const std::vector<Vector3F>& rPoints)
 	{
+		if (rPoints.empty())
+		{
+			return false;
+		}
+
 		Vector3F centroid;
 		for (unsigned int i = 0; i < rPoints.size(); i++)
 		{
@@ -31,11 +45,11 @@ struct OBB : public BoundingVolume
 		Matrix3F covariance;
 		for (unsigned int i = 0; i < rPoints.size(); i++)
 		{
-			Vector3F& rV1 = rPoints[i] - centroid;
+			Vector3F v1 = rPoints[i] - centroid;
 
-			float m11 = rV1.x() * rV1.x(); float m12 = rV1.x() * rV1.y(); float m13 = rV1.x() * rV1.z();
-			float m21 = m12; float m22 = rV1.y() * rV1.y(); float m23 = rV1.y() * rV1.z();
-			float m31 = m13; float m32 = m23; float m33 = rV1.z() * rV1.z();
+			float m11 = v1.x() * v1.x(); float m12 = v1.x() * v1.y(); float m13 = v1.x() * v1.z();
+			float m21 = m12; float m22 = v1.y() * v1.y(); float m23 = v1.y() * v1.z();
+			float m31 = m13; float m32 = m23; float m33 = v1.z() * v1.z();
 
 			covariance += Matrix3F(m11, m12, m13,
 								   m21, m22, m23,
@@ -44,84 +58,80 @@ struct OBB : public BoundingVolume
 
 		EigenSolver solver(covariance);
 		solver.SortDescreasingly();
-		axis[0] = solver.GetEigenVector(0).Normalized();
-		axis[1] = solver.GetEigenVector(1).Normalized();
-		axis[2] = solver.GetEigenVector(2).Normalized();
 
-		minValues = Vector3F(MAX_VALUE, MAX_VALUE, MAX_VALUE);
-		maxValues = Vector3F(-MAX_VALUE, -MAX_VALUE, -MAX_VALUE);
-		for (unsigned int i = 0; i < rPoints.size(); i++)
+		// the extents are only conservative along an orthonormal basis, so the solver output is orthonormalized
+		axis[0] = solver.GetEigenVector(0).Normalized();
+		axis[1] = solver.GetEigenVector(1);
+		axis[1] = (axis[1] - axis[0] * axis[0].Dot(axis[1])).Normalized();
+		axis[2] = axis[0].Cross(axis[1]);
+		if (!IsFinite(axis[0]) || !IsFinite(axis[1]) || !IsFinite(axis[2]) || axis[2].Length() < 0.5f)
 		{
-			Vector3F vector(axis[0].Dot(rPoints[i]), axis[1].Dot(rPoints[i]), axis[2].Dot(rPoints[i]));
-
-			minValues.x() = srt_min(vector.x(), minValues.x());
-			minValues.y() = srt_min(vector.y(), minValues.y());
-			minValues.z() = srt_min(vector.z(), minValues.z());
-			
-			maxValues.x() = srt_max(vector.x(), maxValues.x());
-			maxValues.y() = srt_max(vector.y(), maxValues.y());
-			maxValues.z() = srt_max(vector.z(), maxValues.z());
+			axis[0] = Vector3F(1, 0, 0);
+			axis[1] = Vector3F(0, 1, 0);
+			axis[2] = Vector3F(0, 0, 1);
 		}
 
-		center = Matrix3F(axis[0], axis[1], axis[2]) * ((maxValues + minValues) / 2.0f);
+		ComputeExtents(rPoints);
 
 		return true;
 	}
 
-	virtual bool Intersect(const Ray& rRay) const
+	virtual std::unique_ptr<BoundingVolume> Clone() const
 	{
-		float t0 = 0.0f;
-		float t1 = 1.0f;
-
-		Vector3F rayOrigin(axis[0].Dot(rRay.origin), axis[1].Dot(rRay.origin), axis[2].Dot(rRay.origin));
-		Vector3F rayDirection(axis[0].Dot(rRay.direction), axis[1].Dot(rRay.direction), axis[2].Dot(rRay.direction));
-
-		if (!RaySlabIntersection(rayOrigin.x(), rayDirection.x(), mCurrentMinimums.x(), mCurrentMaximums.x(), t0, t1)) 
-		{
-			return false;
-		}
-
-		if (!RaySlabIntersection(rayOrigin.y(), rayDirection.y(), mCurrentMinimums.y(), mCurrentMaximums.y(), t0, t1)) 
-		{
-			return false;
-		}
-		
-		if (!RaySlabIntersection(rayOrigin.z(), rayDirection.z(), mCurrentMinimums.z(), mCurrentMaximums.z(), t0, t1)) 
-		{
-			return false;
-		}
+		return std::unique_ptr<BoundingVolume>(new OBB(*this));
+	}
 
-		return true;
+	// in box space the OBB is an AABB, so it takes the branchless slab test of the ray
+	virtual bool Intersect(const Ray& rRay) const
+	{
+		float tEntry;
+		return AABB(minValues, maxValues).Intersect(ToVolumeSpace(rRay, mBoxFromWorld, mBoxFromWorldScale), tEntry);
 	}
 
 	virtual void Update(Transform transform)
 	{
-		mCurrentCenter = transform * center;
+		SetModel(transform);
+		// rows are the axes: projects object space vectors on them
+		mBoxFromWorld = Matrix3F(axis[0], axis[1], axis[2]).Transpose() * mInverseModel;
+		mBoxFromWorldScale = ReciprocalScale(mBoxFromWorld);
 	}
 
-private:
-	Vector3F mCurrentCenter;
-	Vector3F mCurrentMinimums;
-	Vector3F mCurrentMaximums;
+	virtual float SurfaceArea() const
+	{
+		Vector3F extent = maxValues - minValues;
+		return 2.0f * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+	}
 
-	bool RaySlabIntersection(float start, float dir, float _min, float _max, float& t0, float& t1) const
+protected:
+	// projects the points on the axes
+	void ComputeExtents(const std::vector<Vector3F>& rPoints)
 	{
-		if (fabs(dir) < 1.0E-8)
+		minValues = Vector3F(FLT_MAX, FLT_MAX, FLT_MAX);
+		maxValues = Vector3F(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (unsigned int i = 0; i < rPoints.size(); i++)
 		{
-			return (start < _max && start > _min);
-		}
+			Vector3F vector(axis[0].Dot(rPoints[i]), axis[1].Dot(rPoints[i]), axis[2].Dot(rPoints[i]));
 
-		float tmin = (_min - start) / dir;
-		float tmax = (_max - start) / dir;
-		if (tmin > tmax) srt_swap(tmin, tmax);
+			minValues.x() = srt_min(vector.x(), minValues.x());
+			minValues.y() = srt_min(vector.y(), minValues.y());
+			minValues.z() = srt_min(vector.z(), minValues.z());
 
-		if (tmax < t0 || tmin > t1)
-			return false;
+			maxValues.x() = srt_max(vector.x(), maxValues.x());
+			maxValues.y() = srt_max(vector.y(), maxValues.y());
+			maxValues.z() = srt_max(vector.z(), maxValues.z());
+		}
 
-		if (tmin > t0) t0 = tmin;
-		if (tmax < t1)  t1  = tmax;
+		center = Matrix3F(axis[0], axis[1], axis[2]) * ((maxValues + minValues) / 2.0f);
+	}
 
-		return true;
+private:
+	Matrix3F mBoxFromWorld;
+	// see ReciprocalScale
+	Vector3F mBoxFromWorldScale;
+
+	static inline bool IsFinite(const Vector3F& rVector)
+	{
+		return std::isfinite(rVector.x()) && std::isfinite(rVector.y()) && std::isfinite(rVector.z());
 	}
 
 };
@@ -0,0 +1,28 @@
+#ifndef OCCLUDER_H_
+#define OCCLUDER_H_
+
+#include <climits>
+
+// scene object and primitive that blocked a shadow ray
+struct Occluder
+{
+	// UINT_MAX while nothing has been recorded
+	unsigned int sceneObject;
+	unsigned int primitive;
+	// generation of the snapshot it was recorded in, indices from other generations may refer to other objects
+	unsigned int generation;
+
+	Occluder() :
+		sceneObject(UINT_MAX),
+		primitive(0),
+		generation(0)
+	{
+	}
+
+	~Occluder()
+	{
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -117,7 +117,7 @@ void OpenGLRenderer::Render()
 //////////////////////////////////////////////////////////////////////////
 void OpenGLRenderer::RenderMesh(unsigned int i, std::shared_ptr<Mesh>& mesh)
 {
-	RenderTriangles(mesh->model(), mesh->indices, mesh->vertices, mesh->normals, mesh->uvs);
+	RenderTriangles(mesh->model(), mesh->geometry->indices, mesh->geometry->vertices, mesh->geometry->normals, mesh->geometry->uvs);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -130,7 +130,7 @@ void OpenGLRenderer::RenderSphere(unsigned int i, std::shared_ptr<Sphere>& spher
 		it = mSphereMeshes.find(i);
 		assert(it != mSphereMeshes.end());
 	}
-	RenderTriangles(sphere->model(), it->second->indices, it->second->vertices, it->second->normals, it->second->uvs);
+	RenderTriangles(sphere->model(), it->second->geometry->indices, it->second->geometry->vertices, it->second->geometry->normals, it->second->geometry->uvs);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -230,10 +230,10 @@ std::unique_ptr<Mesh> OpenGLRenderer::CreateMeshForSphere(std::shared_ptr<Sphere
 
 			Vector3F normal(nX, nY, nZ);
 
-			mesh->vertices.push_back(Vector3F(x, y, z));
-			mesh->normals.push_back(normal);
+			mesh->geometry->vertices.push_back(Vector3F(x, y, z));
+			mesh->geometry->normals.push_back(normal);
 
-			mesh->uvs.push_back(Vector2F(asin(normal.x()) / srt_PI + 0.5f, asin(normal.y()) / srt_PI + 0.5f));
+			mesh->geometry->uvs.push_back(Vector2F(asin(normal.x()) / srt_PI + 0.5f, asin(normal.y()) / srt_PI + 0.5f));
 
 			v += vStep;
 		}
@@ -245,12 +245,12 @@ std::unique_ptr<Mesh> OpenGLRenderer::CreateMeshForSphere(std::shared_ptr<Sphere
 		for (unsigned j = 0; j < SPHERE_MESH_SLICES - 1; j++)
 		{
 			unsigned int p = i * SPHERE_MESH_SLICES + j;
-			mesh->indices.push_back(p);
-			mesh->indices.push_back(p + SPHERE_MESH_SLICES);
-			mesh->indices.push_back(p + SPHERE_MESH_SLICES + 1);
-			mesh->indices.push_back(p);
-			mesh->indices.push_back(p + SPHERE_MESH_SLICES + 1);
-			mesh->indices.push_back(p + 1);
+			mesh->geometry->indices.push_back(p);
+			mesh->geometry->indices.push_back(p + SPHERE_MESH_SLICES);
+			mesh->geometry->indices.push_back(p + SPHERE_MESH_SLICES + 1);
+			mesh->geometry->indices.push_back(p);
+			mesh->geometry->indices.push_back(p + SPHERE_MESH_SLICES + 1);
+			mesh->geometry->indices.push_back(p + 1);
 		}
 	}
 
@@ -0,0 +1,53 @@
+#ifndef PATHSEGMENT_H_
+#define PATHSEGMENT_H_
+
+#include "Ray.h"
+#include "RayHit.h"
+#include "RayMetadata.h"
+#include "HitAttributes.h"
+#include "SceneObject.h"
+#include "ColorRGBA.h"
+
+// one surface query of the wavefront integrator (what a TraceSurface call is to the recursive one).
+// segments spawned by a hit (reflection/refraction and the surface behind a transparent one) point back to it
+// and are resolved into its color once every queue has been traced
+struct PathSegment
+{
+	static const unsigned int NONE = ~0u;
+
+	// the query interval and the primitive the segment starts on travel with the ray
+	Ray ray;
+	unsigned int iteration;
+	// null for segments whose metadata is never inspected
+	RayMetadata* pRayMetadata;
+
+	bool hit;
+	RayHit rayHit;
+	unsigned int sceneObjectIndex;
+	const SceneObject* pSceneObject;
+	HitAttributes attributes;
+	// direct light after shading, the final color of the segment after resolving
+	ColorRGBA color;
+	// reflection/refraction segment (NONE if it wasn't traced) and segment behind a transparent surface
+	unsigned int secondary;
+	unsigned int behind;
+
+	PathSegment(const Ray& rRay, unsigned int iteration, RayMetadata* pRayMetadata) :
+		ray(rRay),
+		iteration(iteration),
+		pRayMetadata(pRayMetadata),
+		hit(false),
+		sceneObjectIndex(0),
+		pSceneObject(nullptr),
+		secondary(NONE),
+		behind(NONE)
+	{
+	}
+
+	~PathSegment()
+	{
+	}
+
+};
+
+#endif
\ No newline at end of file
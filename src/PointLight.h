@@ -1,6 +1,9 @@
 #ifndef POINTLIGHT_H_
 #define POINTLIGHT_H_
 
+#include <cfloat>
+
+#include "Common.h"
 #include "Light.h"
 #include "Vector3F.h"
 
@@ -26,6 +29,20 @@ struct PointLight : public Light
 		this->attenuation = attenuation;
 	}
 
+	// distance past which the light adds less than cutoff to every color channel of a surface lit by it (material colors
+	// are assumed to be no brighter than 1). Blinn-Phong is bounded by intensity * (diffuse + specular) and falls off
+	// with 1 / (attenuation * distance). lights without a cutoff reach everywhere
+	inline float InfluenceRadius(float cutoff) const
+	{
+		if (cutoff <= 0 || attenuation <= 0)
+		{
+			return FLT_MAX;
+		}
+
+		float brightness = srt_max(srt_max(diffuseColor.r() + specularColor.r(), diffuseColor.g() + specularColor.g()), diffuseColor.b() + specularColor.b());
+		return (intensity * brightness) / (attenuation * cutoff);
+	}
+
 };
 
 #endif
\ No newline at end of file
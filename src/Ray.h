@@ -1,23 +1,113 @@
 #ifndef RAY_H_
 #define RAY_H_
 
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
 #include "Vector3F.h"
 
 struct Ray
 {
+	static const unsigned int NO_ORIGIN = ~0u;
+
 	Vector3F origin;
 	Vector3F direction;
+	// computed once per ray for the slab tests of every box it meets. sign[i] is 1 if the ray runs towards -i
+	Vector3F inverseDirection;
+	unsigned int sign[3];
+	// direction . direction, computed once per ray for the quadratics of every sphere it meets
+	float directionDot;
+	// only hits in (tMin, tMax] count. closest-hit queries shrink tMax as they find hits, which culls everything farther away
+	float tMin;
+	mutable float tMax;
+	// scene object and primitive (e.g., mesh triangle) the ray leaves from, NO_ORIGIN for rays that don't start on a surface.
+	// queries skip that primitive alone, so the ray can't hit the surface it starts on but still sees the rest of its object
+	unsigned int originSceneObject;
+	unsigned int originPrimitive;
+
+	Ray(const Vector3F& rOrigin, const Vector3F& rDirection, float tMin = 0, float tMax = FLT_MAX) :
+		origin(rOrigin),
+		direction(rDirection),
+		inverseDirection(1.0f / rDirection.x(), 1.0f / rDirection.y(), 1.0f / rDirection.z()),
+		tMin(tMin),
+		tMax(tMax),
+		originSceneObject(NO_ORIGIN),
+		originPrimitive(NO_ORIGIN)
+	{
+		directionDot = direction.Dot(direction);
+		sign[0] = (inverseDirection.x() < 0) ? 1 : 0;
+		sign[1] = (inverseDirection.y() < 0) ? 1 : 0;
+		sign[2] = (inverseDirection.z() < 0) ? 1 : 0;
+	}
 
-	Ray(const Vector3F& rOrigin, const Vector3F& rDirection) :
+	// for rays whose reciprocal direction is already known (e.g., rays taken out of a packet)
+	Ray(const Vector3F& rOrigin, const Vector3F& rDirection, const Vector3F& rInverseDirection, float tMin, float tMax) :
 		origin(rOrigin),
-		direction(rDirection)
+		direction(rDirection),
+		inverseDirection(rInverseDirection),
+		tMin(tMin),
+		tMax(tMax),
+		originSceneObject(NO_ORIGIN),
+		originPrimitive(NO_ORIGIN)
 	{
+		directionDot = direction.Dot(direction);
+		sign[0] = (inverseDirection.x() < 0) ? 1 : 0;
+		sign[1] = (inverseDirection.y() < 0) ? 1 : 0;
+		sign[2] = (inverseDirection.z() < 0) ? 1 : 0;
 	}
 
 	~Ray()
 	{
 	}
 
+	// origin of a ray leaving a surface point towards rDirection. the point is pushed off the surface along its normal,
+	// on the side the ray goes to, so that rounding errors in the hit point don't make it hit the primitives around it.
+	// the offset is a fixed number of ulps of each coordinate, so it holds at any distance from the world origin
+	// (Waechter and Binder, "A Fast and Robust Method for Avoiding Self-Intersection")
+	static Vector3F OffsetOrigin(const Vector3F& rPoint, const Vector3F& rNormal, const Vector3F& rDirection)
+	{
+		static const float ORIGIN = 1.0f / 32.0f;
+		static const float FLOAT_SCALE = 1.0f / 65536.0f;
+		static const float INT_SCALE = 256.0f;
+
+		Vector3F normal = (rDirection.Dot(rNormal) < 0) ? -rNormal : rNormal;
+		Vector3F offsetPoint;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			// coordinates close to 0 have tiny ulps, so they are offset by a fixed amount instead
+			if (fabs(rPoint[i]) < ORIGIN)
+			{
+				offsetPoint[i] = rPoint[i] + FLOAT_SCALE * normal[i];
+				continue;
+			}
+
+			int ulps = static_cast<int>(INT_SCALE * normal[i]);
+			int bits;
+			memcpy(&bits, &rPoint[i], sizeof(float));
+			bits += (rPoint[i] < 0) ? -ulps : ulps;
+			memcpy(&offsetPoint[i], &bits, sizeof(float));
+		}
+		return offsetPoint;
+	}
+
+	inline void SetOrigin(unsigned int sceneObject, unsigned int primitive)
+	{
+		originSceneObject = sceneObject;
+		originPrimitive = primitive;
+	}
+
+	// primitive of a scene object the ray has to skip, NO_ORIGIN if none
+	inline unsigned int IgnoredPrimitive(unsigned int sceneObject) const
+	{
+		return (sceneObject == originSceneObject) ? originPrimitive : NO_ORIGIN;
+	}
+
+	inline bool Contains(float t) const
+	{
+		return t > tMin && t <= tMax;
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -1,23 +1,22 @@
 #ifndef RAYHIT_H_
 #define RAYHIT_H_
 
-#include "Vector3F.h"
-#include "Vector2F.h"
-
+// compact record of an intersection. surface attributes are evaluated from it once the closest hit is known
 struct RayHit
 {
-	Vector3F point;
-	Vector3F normal;
-	Vector2F uv;
-
-	RayHit()
-	{
-	}
+	float t;
+	// primitive that was hit (e.g., mesh triangle), 0 for single primitive objects
+	unsigned int primitive;
+	// barycentric coordinates of the hit inside the primitive
+	float u;
+	float v;
 
-	RayHit(const Vector3F& point, const Vector3F& normal)
+	RayHit() :
+		t(0),
+		primitive(0),
+		u(0),
+		v(0)
 	{
-		this->point = point;
-		this->normal = normal;
 	}
 
 	~RayHit()
@@ -0,0 +1,211 @@
+#ifndef RAYPACKET_H_
+#define RAYPACKET_H_
+
+#include <cfloat>
+#include <xmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "AABB.h"
+#include "Ray.h"
+#include "Vector3F.h"
+
+// bundle of coherent rays (e.g., the primary rays of a screen tile) traced together.
+// rays are stored in structure of arrays form and selected by bit masks
+struct RayPacket
+{
+	static const unsigned int MAX_SIZE = 64;
+
+	unsigned int size;
+	alignas(16) float originX[MAX_SIZE];
+	alignas(16) float originY[MAX_SIZE];
+	alignas(16) float originZ[MAX_SIZE];
+	alignas(16) float directionX[MAX_SIZE];
+	alignas(16) float directionY[MAX_SIZE];
+	alignas(16) float directionZ[MAX_SIZE];
+	alignas(16) float inverseDirectionX[MAX_SIZE];
+	alignas(16) float inverseDirectionY[MAX_SIZE];
+	alignas(16) float inverseDirectionZ[MAX_SIZE];
+	// closest hit so far of every ray, queries shrink it
+	alignas(16) float tMax[MAX_SIZE];
+
+	RayPacket() :
+		size(0)
+	{
+	}
+
+	~RayPacket()
+	{
+	}
+
+	static inline unsigned long long Bit(unsigned int i)
+	{
+		return 1ull << i;
+	}
+
+	// index of the lowest ray in a non-empty mask
+	static inline unsigned int FirstRay(unsigned long long rayMask)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward64(&i, rayMask);
+		return static_cast<unsigned int>(i);
+#else
+		return static_cast<unsigned int>(__builtin_ctzll(rayMask));
+#endif
+	}
+
+	inline unsigned long long AllRays() const
+	{
+		return (size == MAX_SIZE) ? ~0ull : (Bit(size) - 1);
+	}
+
+	// packet rays always start at tMin = 0
+	inline void SetRay(unsigned int i, const Ray& rRay)
+	{
+		originX[i] = rRay.origin.x();
+		originY[i] = rRay.origin.y();
+		originZ[i] = rRay.origin.z();
+		directionX[i] = rRay.direction.x();
+		directionY[i] = rRay.direction.y();
+		directionZ[i] = rRay.direction.z();
+		inverseDirectionX[i] = rRay.inverseDirection.x();
+		inverseDirectionY[i] = rRay.inverseDirection.y();
+		inverseDirectionZ[i] = rRay.inverseDirection.z();
+		tMax[i] = rRay.tMax;
+	}
+
+	inline Ray GetRay(unsigned int i) const
+	{
+		return Ray(Vector3F(originX[i], originY[i], originZ[i]), Vector3F(directionX[i], directionY[i], directionZ[i]), Vector3F(inverseDirectionX[i], inverseDirectionY[i], inverseDirectionZ[i]), 0, tMax[i]);
+	}
+
+	// bounds of the origins and reciprocal directions of a set of rays, per axis. a box missed by every ray the
+	// intervals describe is missed by each of the rays, so a single test culls a node for the whole packet
+	struct Interval
+	{
+		float minimumOrigin[3];
+		float maximumOrigin[3];
+		float minimumInverseDirection[3];
+		float maximumInverseDirection[3];
+		// axes on which the directions don't share a sign (or are parallel to the slabs) can't be used for culling
+		bool culling[3];
+		float tMax;
+
+	};
+
+	// subsets of rayMask are bounded by the same interval, it only needs to be computed once per traversal
+	Interval ComputeInterval(unsigned long long rayMask) const
+	{
+		const float* pOrigins[3] = { originX, originY, originZ };
+		const float* pInverseDirections[3] = { inverseDirectionX, inverseDirectionY, inverseDirectionZ };
+
+		Interval interval;
+		interval.tMax = 0;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			interval.minimumOrigin[axis] = interval.minimumInverseDirection[axis] = FLT_MAX;
+			interval.maximumOrigin[axis] = interval.maximumInverseDirection[axis] = -FLT_MAX;
+		}
+
+		for (; rayMask != 0; rayMask &= rayMask - 1)
+		{
+			unsigned int i = FirstRay(rayMask);
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				interval.minimumOrigin[axis] = srt_min(interval.minimumOrigin[axis], pOrigins[axis][i]);
+				interval.maximumOrigin[axis] = srt_max(interval.maximumOrigin[axis], pOrigins[axis][i]);
+				interval.minimumInverseDirection[axis] = srt_min(interval.minimumInverseDirection[axis], pInverseDirections[axis][i]);
+				interval.maximumInverseDirection[axis] = srt_max(interval.maximumInverseDirection[axis], pInverseDirections[axis][i]);
+			}
+			interval.tMax = srt_max(interval.tMax, tMax[i]);
+		}
+
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			bool positive = interval.minimumInverseDirection[axis] > 0 && interval.maximumInverseDirection[axis] < FLT_MAX;
+			bool negative = interval.maximumInverseDirection[axis] < 0 && interval.minimumInverseDirection[axis] > -FLT_MAX;
+			interval.culling[axis] = positive || negative;
+		}
+
+		return interval;
+	}
+
+	// interval culling: false if no ray bounded by rInterval can enter the box inside [0, rInterval.tMax]
+	static bool MayIntersect(const Interval& rInterval, const AABB& rBounds)
+	{
+		float tNear = 0;
+		float tFar = rInterval.tMax;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			if (!rInterval.culling[axis])
+			{
+				continue;
+			}
+
+			// slab distances of the near and far planes, as intervals over the rays
+			bool positive = rInterval.minimumInverseDirection[axis] > 0;
+			float nearPlane = (positive) ? rBounds.minimum[axis] : rBounds.maximum[axis];
+			float farPlane = (positive) ? rBounds.maximum[axis] : rBounds.minimum[axis];
+			float axisNear = IntervalProductMinimum(nearPlane - rInterval.maximumOrigin[axis], nearPlane - rInterval.minimumOrigin[axis], rInterval.minimumInverseDirection[axis], rInterval.maximumInverseDirection[axis]);
+			float axisFar = IntervalProductMaximum(farPlane - rInterval.maximumOrigin[axis], farPlane - rInterval.minimumOrigin[axis], rInterval.minimumInverseDirection[axis], rInterval.maximumInverseDirection[axis]);
+			tNear = srt_max(tNear, axisNear);
+			tFar = srt_min(tFar, axisFar);
+			if (tNear > tFar)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// per ray slab test against a box inside [0, tMax], with the same NaN rule as AABB::Intersect. returns the rays of mask that hit it.
+	// rays are tested 4 at a time, lanes outside the mask may hold anything
+	unsigned long long Intersect(const AABB& rBounds, unsigned long long mask) const
+	{
+		const float* pOrigins[3] = { originX, originY, originZ };
+		const float* pInverseDirections[3] = { inverseDirectionX, inverseDirectionY, inverseDirectionZ };
+
+		unsigned long long hits = 0;
+		for (unsigned int i = 0; i < size; i += 4)
+		{
+			if (((mask >> i) & 0xf) == 0)
+			{
+				continue;
+			}
+
+			__m128 tNear = _mm_setzero_ps();
+			__m128 tFar = _mm_load_ps(tMax + i);
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				__m128 origin = _mm_load_ps(pOrigins[axis] + i);
+				__m128 inverseDirection = _mm_load_ps(pInverseDirections[axis] + i);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(rBounds.minimum[axis]), origin), inverseDirection);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(rBounds.maximum[axis]), origin), inverseDirection);
+				__m128 parallel = _mm_cmpunord_ps(t0, t1);
+				__m128 axisNear = _mm_or_ps(_mm_and_ps(parallel, _mm_set1_ps(-FLT_MAX)), _mm_andnot_ps(parallel, _mm_min_ps(t0, t1)));
+				__m128 axisFar = _mm_or_ps(_mm_and_ps(parallel, _mm_set1_ps(FLT_MAX)), _mm_andnot_ps(parallel, _mm_max_ps(t0, t1)));
+				tNear = _mm_max_ps(tNear, axisNear);
+				tFar = _mm_min_ps(tFar, axisFar);
+			}
+			hits |= static_cast<unsigned long long>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) << i;
+		}
+		return hits & mask;
+	}
+
+private:
+	static inline float IntervalProductMinimum(float a0, float a1, float b0, float b1)
+	{
+		return srt_min(srt_min(a0 * b0, a0 * b1), srt_min(a1 * b0, a1 * b1));
+	}
+
+	static inline float IntervalProductMaximum(float a0, float a1, float b0, float b1)
+	{
+		return srt_max(srt_max(a0 * b0, a0 * b1), srt_max(a1 * b0, a1 * b1));
+	}
+
+};
+
+#endif
\ No newline at end of file
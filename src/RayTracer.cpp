@@ -3,22 +3,30 @@
 #include <GL/GLU.h>
 #include "glext.h"
 #include <cmath>
+#include <cfloat>
+#include <climits>
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <mutex>
 
 #include "Common.h"
 #include "RayTracer.h"
 #include "Camera.h"
 #include "RayHit.h"
+#include "RayPacket.h"
 #include "Light.h"
-#include "DirectionalLight.h"
-#include "PointLight.h"
+#include "LightBuffer.h"
 #include "Material.h"
 #include "Vector3F.h"
 #include "Vector4F.h"
 #include "Matrix3x3F.h"
 #include "Matrix4x4F.h"
+#include "Morton.h"
+#include "TaskScheduler.h"
 #include "SimpleRayTracerApp.h"
 
 const unsigned int RayTracer::DEPTH_BUFFER_SIZE = SimpleRayTracerApp::SCREEN_WIDTH * SimpleRayTracerApp::SCREEN_HEIGHT;
@@ -26,6 +34,9 @@ const unsigned int RayTracer::COLOR_BUFFER_SIZE = DEPTH_BUFFER_SIZE * SimpleRayT
 const unsigned int RayTracer::RAYS_METADATA_SIZE = SimpleRayTracerApp::SCREEN_WIDTH * SimpleRayTracerApp::SCREEN_HEIGHT;
 const unsigned int RayTracer::MAX_ITERATIONS = 5;
 
+thread_local std::vector<Occluder> RayTracer::s_mOccluderCache;
+thread_local ShadowCacheStatistics RayTracer::s_mShadowCacheStatistics;
+
 #define srt_clampColor(v, vmin, vmax) \
 	(v).r() = (((v).r() < (vmin)) ? (vmin) : (((v).r() > (vmax)) ? (vmax) : (v).r())); \
 	(v).g() = (((v).g() < (vmin)) ? (vmin) : (((v).g() > (vmax)) ? (vmax) : (v).g())); \
@@ -72,7 +83,13 @@ RayTracer::RayTracer() :
 	mpTextureData(nullptr),
 	mpDepthBuffer(nullptr),
 	mDebug(true),
-	mCollectRayMetadata(false)
+	mCollectRayMetadata(false),
+	mWavefront(false),
+	mPacketSize(8),
+	mTileSize(32),
+	mNumberOfThreads(0),
+	mTileCostsGeneration(0),
+	mpSnapshot(nullptr)
 {
 }
 
@@ -96,6 +113,26 @@ RayTracer::~RayTracer()
 	mpRaysMetadata = nullptr;
 }
 
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::SetPacketSize(unsigned int packetSize)
+{
+	if (packetSize != 1 && packetSize != 2 && packetSize != 4 && packetSize != 8)
+	{
+		throw std::runtime_error("unsupported packet size");
+	}
+	mPacketSize = packetSize;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::SetTileSize(unsigned int tileSize)
+{
+	if (tileSize == 0)
+	{
+		throw std::runtime_error("tile size must be greater than 0");
+	}
+	mTileSize = tileSize;
+}
+
 //////////////////////////////////////////////////////////////////////////
 void RayTracer::Start()
 {
@@ -257,134 +294,557 @@ void RayTracer::SetRayMetadataHitPoint(RayMetadata& rRayMetadata, const Vector3F
 //////////////////////////////////////////////////////////////////////////
 void RayTracer::TraceRays(std::unique_ptr<unsigned char[]>& colorBuffer)
 {
-	auto numSteps = SimpleRayTracerApp::SCREEN_WIDTH * SimpleRayTracerApp::SCREEN_HEIGHT;
-	for (unsigned int y = 0, colorBufferIndex = 0, depthBufferIndex = 0, rayMetadataIndex = 0, step = 0; y < SimpleRayTracerApp::SCREEN_HEIGHT; y++)
+	// tracing only reads the snapshot, never the scene graph
+	mpSnapshot = &mScene->GetSnapshot();
+
+	TaskScheduler& rScheduler = TaskScheduler::GetInstance();
+	unsigned int numberOfThreads = (mNumberOfThreads == 0) ? rScheduler.NumberOfThreads() : srt_min(mNumberOfThreads, rScheduler.NumberOfThreads());
+
+	// tile costs measured before scene objects were added or removed don't match the frame. a new scene always
+	// takes a new generation too, so its frames never start with the costs of the previous one
+	if (mpSnapshot->GetGeneration() != mTileCostsGeneration)
 	{
-		for (unsigned int x = 0; x < SimpleRayTracerApp::SCREEN_WIDTH; x++, colorBufferIndex += 4, depthBufferIndex++, rayMetadataIndex++, step++)
+		mTileScheduler.Reset();
+		mTileCostsGeneration = mpSnapshot->GetGeneration();
+	}
+
+	// every thread starts with a contiguous run of tiles and steals from the others once it's done with them. tiles don't
+	// overlap, so every thread writes its pixels (color, depth and metadata) straight into the frame buffers
+	mTileScheduler.BeginFrame(SimpleRayTracerApp::SCREEN_WIDTH, SimpleRayTracerApp::SCREEN_HEIGHT, mTileSize, numberOfThreads);
+	unsigned int numberOfTiles = mTileScheduler.NumberOfTiles();
+	std::atomic<unsigned int> tracedTiles(0);
+	std::mutex progressMutex;
+
+	// the counters of the threads are gathered into the frame totals and given to the calling thread in the end
+	std::mutex statisticsMutex;
+	BVHStatistics bvhStatistics;
+	ShadowCacheStatistics shadowCacheStatistics;
+
+	auto traceTiles = [&](unsigned int worker)
+	{
+		BVHStatistics threadBVHStatistics = BVH::GetStatistics();
+		ShadowCacheStatistics threadShadowCacheStatistics = GetShadowCacheStatistics();
+		BVH::ResetStatistics();
+		ResetShadowCacheStatistics();
+
+		// tiles are timed so that the next frame can split the expensive ones
+		unsigned int tile;
+		while (mTileScheduler.NextTile(worker, tile))
 		{
-			Ray rRay = mScene->GetCamera()->GetRayFromScreenCoordinates(x, y);
-			if (mCollectRayMetadata)
-				ResetRayMetadata(mpRaysMetadata[rayMetadataIndex], rRay.origin, rRay.direction);
-			ColorRGBA color = TraceRay(rRay, mpRaysMetadata[rayMetadataIndex], &mpDepthBuffer[depthBufferIndex], 0);
-			srt_setColor(colorBuffer, colorBufferIndex, color);
+			const Tile& rTile = mTileScheduler.GetTile(tile);
+			auto start = std::chrono::steady_clock::now();
+			TraceTile(rTile.x0, rTile.y0, rTile.x1, rTile.y1, colorBuffer);
+			auto end = std::chrono::steady_clock::now();
+			mTileScheduler.EndTile(tile, std::chrono::duration<double>(end - start).count());
+
+			tracedTiles++;
+			// whichever thread finishes a tile reports the progress of the whole frame, unless another one is already at it
+			if (mDebug && progressMutex.try_lock())
+			{
+				std::fprintf(stdout, "\rTracing rays (%.3f%%)", (tracedTiles.load() / (double)numberOfTiles) * 100);
+				progressMutex.unlock();
+			}
 		}
-		if (mDebug)
-			std::fprintf(stdout, "\rTracing rays (%.3f%%)", (step / (double)numSteps) * 100);
+
+		std::lock_guard<std::mutex> lock(statisticsMutex);
+		bvhStatistics.nodeVisits += BVH::GetStatistics().nodeVisits;
+		bvhStatistics.primitiveTests += BVH::GetStatistics().primitiveTests;
+		shadowCacheStatistics.lookups += GetShadowCacheStatistics().lookups;
+		shadowCacheStatistics.hits += GetShadowCacheStatistics().hits;
+		BVH::GetStatistics() = threadBVHStatistics;
+		GetShadowCacheStatistics() = threadShadowCacheStatistics;
+	};
+
+	// the calling thread is worker 0
+	TaskGroup group;
+	for (unsigned int i = 1; i < numberOfThreads; i++)
+	{
+		rScheduler.Spawn(group, [&, i]()
+		{
+			traceTiles(i);
+		});
 	}
+	traceTiles(0);
+	rScheduler.Wait(group);
+	mTileScheduler.EndFrame();
+
+	BVH::GetStatistics().nodeVisits += bvhStatistics.nodeVisits;
+	BVH::GetStatistics().primitiveTests += bvhStatistics.primitiveTests;
+	GetShadowCacheStatistics().lookups += shadowCacheStatistics.lookups;
+	GetShadowCacheStatistics().hits += shadowCacheStatistics.hits;
+
 	if (mDebug)
-		std::fprintf(stdout, "\n");
+	{
+		const TileSchedulerStatistics& rStatistics = mTileScheduler.GetStatistics();
+		std::fprintf(stdout, "\rTracing rays (%.3f%%)", 100.0);
+		std::fprintf(stdout, "\n%u tiles (%u split), %u steals, load imbalance: %.1f%%\n", rStatistics.numberOfTiles, rStatistics.splitGridTiles, rStatistics.steals, rStatistics.LoadImbalance() * 100);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
-ColorRGBA RayTracer::TraceRay(const Ray& rRay, RayMetadata& rRayMetadata, float* pCurrentDepth, unsigned int iteration, std::shared_ptr<SceneObject> sceneObjectToIgnore) const
+void RayTracer::TraceTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, std::unique_ptr<unsigned char[]>& colorBuffer)
 {
-	ColorRGBA finalColor = SimpleRayTracerApp::CLEAR_COLOR;
-
-	if (iteration > MAX_ITERATIONS)
+	if (mWavefront)
 	{
-		return finalColor;
+		TraceTileWavefront(x0, y0, x1, y1, colorBuffer);
+		return;
 	}
 
-	for (unsigned int i = 0; i < mScene->NumberOfSceneObjects(); i++)
+	if (mPacketSize > 1)
 	{
-		if (auto sceneObject = mScene->GetSceneObject(i).lock())
+		for (unsigned int y = y0; y < y1; y += mPacketSize)
 		{
-			if (sceneObjectToIgnore != 0 && sceneObject == sceneObjectToIgnore)
+			for (unsigned int x = x0; x < x1; x += mPacketSize)
 			{
-				continue;
+				TracePacket(x, y, srt_min(mPacketSize, x1 - x), srt_min(mPacketSize, y1 - y), colorBuffer);
 			}
+		}
+		return;
+	}
 
-			RayHit hit;
-			if (sceneObject->Intersect(rRay, hit))
-			{
-				float depth = rRay.origin.Distance(hit.point);
+	for (unsigned int y = y0; y < y1; y++)
+	{
+		for (unsigned int x = x0; x < x1; x++)
+		{
+			unsigned int pixelIndex = y * SimpleRayTracerApp::SCREEN_WIDTH + x;
+			Ray rRay = mpSnapshot->GetCamera().GetRayFromScreenCoordinates(x, y);
+			if (mCollectRayMetadata)
+				ResetRayMetadata(mpRaysMetadata[pixelIndex], rRay.origin, rRay.direction);
+			ColorRGBA color = TraceRay(rRay, mpRaysMetadata[pixelIndex], &mpDepthBuffer[pixelIndex], 0);
+			srt_setColor(colorBuffer, pixelIndex * SimpleRayTracerApp::BYTES_PER_PIXEL, color);
+		}
+	}
+}
 
-				if (depth >= *pCurrentDepth)
-				{
-					continue;
-				}
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::TracePacket(unsigned int x0, unsigned int y0, unsigned int width, unsigned int height, std::unique_ptr<unsigned char[]>& colorBuffer)
+{
+	// primary visibility of the whole packet is resolved at once, shading is still done ray by ray
 
-				*pCurrentDepth = depth;
+	RayPacket packet;
+	float directionLengths[RayPacket::MAX_SIZE];
+	float tMaxs[RayPacket::MAX_SIZE];
+	packet.size = width * height;
+	for (unsigned int y = 0, i = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++, i++)
+		{
+			Ray ray = mpSnapshot->GetCamera().GetRayFromScreenCoordinates(x0 + x, y0 + y);
+			// depths are distances along the ray, the scene is queried with ray parameters
+			directionLengths[i] = ray.direction.Length();
+			tMaxs[i] = ray.tMax = mpDepthBuffer[(y0 + y) * SimpleRayTracerApp::SCREEN_WIDTH + x0 + x] / directionLengths[i];
+			packet.SetRay(i, ray);
+		}
+	}
 
-				if (mCollectRayMetadata)
-					SetRayMetadataHitPoint(rRayMetadata, hit.point);
+	RayHit hits[RayPacket::MAX_SIZE];
+	unsigned int sceneObjectIndices[RayPacket::MAX_SIZE];
+	unsigned long long hitMask = mpSnapshot->IntersectPacket(packet, packet.AllRays(), hits, sceneObjectIndices);
 
-				ColorRGBA currentColor = Reflectance(sceneObject, rRay, hit, rRayMetadata, iteration);
+	for (unsigned int y = 0, i = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++, i++)
+		{
+			unsigned int pixelIndex = (y0 + y) * SimpleRayTracerApp::SCREEN_WIDTH + x0 + x;
+			Ray ray = packet.GetRay(i);
+			if (mCollectRayMetadata)
+				ResetRayMetadata(mpRaysMetadata[pixelIndex], ray.origin, ray.direction);
 
-				if (sceneObject->material.transparent)
-				{
-					finalColor = currentColor.Blend(finalColor);
-				}
-				else
+			ColorRGBA color = SimpleRayTracerApp::CLEAR_COLOR;
+			if ((hitMask & RayPacket::Bit(i)) != 0)
+			{
+				float hitT = -1;
+				color = ShadeSurface(ray, mpRaysMetadata[pixelIndex], hits[i], sceneObjectIndices[i], tMaxs[i], &hitT, 0);
+				if (hitT >= 0)
 				{
-					finalColor = currentColor;
+					mpDepthBuffer[pixelIndex] = hitT * directionLengths[i];
 				}
 			}
+			color = mpSnapshot->GetAmbientLight() + color;
+			srt_setColor(colorBuffer, pixelIndex * SimpleRayTracerApp::BYTES_PER_PIXEL, color);
 		}
 	}
-
-	return mScene->ambientLight + finalColor;
 }
 
 //////////////////////////////////////////////////////////////////////////
-ColorRGBA RayTracer::Reflectance(std::shared_ptr<SceneObject>& sceneObject, const Ray &rRay, const RayHit& rHit, RayMetadata& rRayMetadata, unsigned int iteration) const
+void RayTracer::TraceTileWavefront(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, std::unique_ptr<unsigned char[]>& colorBuffer)
 {
-	auto& rMaterial = sceneObject->material;
-	const auto& camera = mScene->GetCamera();
+	const Camera& rCamera = mpSnapshot->GetCamera();
+
+	// every surface query of the tile, in the order the queues were traced. segments are only ever appended,
+	// so the ones spawned by a hit always come after it. the first ones are the primary rays, in scanline order
+	unsigned int numberOfPixels = (x1 - x0) * (y1 - y0);
+	std::vector<PathSegment> segments;
+	std::vector<unsigned int> pixelIndices(numberOfPixels);
+	std::vector<float> directionLengths(numberOfPixels);
+	segments.reserve(numberOfPixels);
+	for (unsigned int y = y0, i = 0; y < y1; y++)
+	{
+		for (unsigned int x = x0; x < x1; x++, i++)
+		{
+			unsigned int pixelIndex = pixelIndices[i] = y * SimpleRayTracerApp::SCREEN_WIDTH + x;
+			Ray ray = rCamera.GetRayFromScreenCoordinates(x, y);
+			if (mCollectRayMetadata)
+				ResetRayMetadata(mpRaysMetadata[pixelIndex], ray.origin, ray.direction);
+			// depths are distances along the ray, the scene is queried with ray parameters
+			directionLengths[i] = ray.direction.Length();
+			ray.tMax = mpDepthBuffer[pixelIndex] / directionLengths[i];
+			segments.emplace_back(ray, 0, (mCollectRayMetadata) ? &mpRaysMetadata[pixelIndex] : nullptr);
+		}
+	}
 
-	ColorRGBA color;
-	Vector3F viewerDirection = (rRay.origin - rHit.point).Normalized();
-	const Vector3F& rNormal = rHit.normal;
+	// each queue holds the segments spawned by the previous one (primary rays first)
+	std::vector<unsigned int> queue;
+	std::vector<unsigned int> hitQueue;
+	for (unsigned int begin = 0, end = static_cast<unsigned int>(segments.size()), depth = 0; begin < end; begin = end, end = static_cast<unsigned int>(segments.size()), depth++)
+	{
+		queue.resize(end - begin);
+		for (unsigned int i = 0; i < queue.size(); i++)
+		{
+			queue[i] = begin + i;
+		}
+
+		// primary rays are already coherent in screen order
+		if (depth > 0)
+		{
+			SortQueue(segments, queue);
+		}
+
+		IntersectQueue(segments, queue, hitQueue);
+		ShadeQueue(segments, hitQueue);
+	}
 
-	for (unsigned int j = 0; j < mScene->NumberOfLights(); j++)
+	// children are resolved before the segments that spawned them
+	for (unsigned int i = static_cast<unsigned int>(segments.size()); i-- > 0;)
 	{
-		const auto& light = mScene->GetLight(j);
+		ResolveSegment(segments, i);
+	}
 
-		float distanceToLight = -1;
-		Vector3F directionToLight;
-		if (srt_is(light, DirectionalLight))
+	for (unsigned int i = 0; i < numberOfPixels; i++)
+	{
+		const PathSegment& rSegment = segments[i];
+		if (rSegment.hit)
 		{
-			directionToLight = -srt_dynPtrCast(light, DirectionalLight)->direction;
+			mpDepthBuffer[pixelIndices[i]] = rSegment.rayHit.t * directionLengths[i];
 		}
-		else if (srt_is(light, PointLight))
+		ColorRGBA color = mpSnapshot->GetAmbientLight() + rSegment.color;
+		srt_setColor(colorBuffer, pixelIndices[i] * SimpleRayTracerApp::BYTES_PER_PIXEL, color);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::SortQueue(const std::vector<PathSegment>& rSegments, std::vector<unsigned int>& rQueue) const
+{
+	// secondary rays are sorted by direction octant and then by the morton code of their origins,
+	// so that rays starting close to each other and heading the same way are traced together
+	AABB originBounds;
+	for (unsigned int i = 0; i < rQueue.size(); i++)
+	{
+		originBounds.Expand(rSegments[rQueue[i]].ray.origin);
+	}
+
+	std::vector<std::pair<unsigned long long, unsigned int> > keys(rQueue.size());
+	for (unsigned int i = 0; i < rQueue.size(); i++)
+	{
+		const Ray& rRay = rSegments[rQueue[i]].ray;
+		unsigned long long octant = ((rRay.direction.x() < 0) ? 1 : 0) | ((rRay.direction.y() < 0) ? 2 : 0) | ((rRay.direction.z() < 0) ? 4 : 0);
+		keys[i].first = (octant << (3 * Morton::BITS_PER_AXIS)) | Morton::Encode(rRay.origin, originBounds);
+		keys[i].second = rQueue[i];
+	}
+	std::sort(keys.begin(), keys.end());
+
+	for (unsigned int i = 0; i < rQueue.size(); i++)
+	{
+		rQueue[i] = keys[i].second;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::IntersectQueue(std::vector<PathSegment>& rSegments, const std::vector<unsigned int>& rQueue, std::vector<unsigned int>& rHitQueue) const
+{
+	rHitQueue.clear();
+	for (unsigned int i = 0; i < rQueue.size(); i++)
+	{
+		PathSegment& rSegment = rSegments[rQueue[i]];
+		// queried on a copy: the segment keeps its full interval for the surface behind it
+		Ray ray = rSegment.ray;
+		if (!mpSnapshot->Intersect(ray, rSegment.rayHit, rSegment.sceneObjectIndex))
 		{
-			directionToLight = (srt_dynPtrCast(light, PointLight)->position - rHit.point);
-			distanceToLight = directionToLight.Length();
-			directionToLight /= distanceToLight;
+			continue;
 		}
-		else 
+
+		rSegment.hit = true;
+		rSegment.pSceneObject = mpSnapshot->GetSceneObject(rSegment.sceneObjectIndex);
+		rHitQueue.push_back(rQueue[i]);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::ShadeQueue(std::vector<PathSegment>& rSegments, std::vector<unsigned int>& rHitQueue) const
+{
+	// hits are shaded grouped by scene object, so that consecutive hits share their material
+	std::stable_sort(rHitQueue.begin(), rHitQueue.end(), [&](unsigned int a, unsigned int b)
+	{
+		return rSegments[a].sceneObjectIndex < rSegments[b].sceneObjectIndex;
+	});
+
+	for (unsigned int i = 0; i < rHitQueue.size(); i++)
+	{
+		PathSegment& rSegment = rSegments[rHitQueue[i]];
+		rSegment.pSceneObject->EvaluateAttributes(rSegment.ray, rSegment.rayHit, rSegment.attributes);
+		if (rSegment.pRayMetadata != nullptr)
+			SetRayMetadataHitPoint(*rSegment.pRayMetadata, rSegment.attributes.point);
+	}
+
+	// one shadow ray per hit and light reaching it. the shadow rays of hit i are [shadowRayOffsets[i], shadowRayOffsets[i + 1])
+	std::vector<unsigned int> shadowRayOffsets(rHitQueue.size() + 1);
+	std::vector<unsigned int> shadowRayLights;
+	for (unsigned int i = 0; i < rHitQueue.size(); i++)
+	{
+		shadowRayOffsets[i] = static_cast<unsigned int>(shadowRayLights.size());
+		mpSnapshot->ForEachLight(rSegments[rHitQueue[i]].attributes.point, [&](unsigned int j)
+		{
+			shadowRayLights.push_back(j);
+		});
+	}
+	unsigned int numberOfShadowRays = static_cast<unsigned int>(shadowRayLights.size());
+	shadowRayOffsets[rHitQueue.size()] = numberOfShadowRays;
+
+	// shadow rays are traced grouped by light, which keeps the per light occluder cache warm
+	std::vector<unsigned int> shadowRayHits(numberOfShadowRays);
+	std::vector<unsigned int> shadowRayQueue(numberOfShadowRays);
+	for (unsigned int i = 0; i < rHitQueue.size(); i++)
+	{
+		for (unsigned int k = shadowRayOffsets[i]; k < shadowRayOffsets[i + 1]; k++)
 		{
-			throw std::runtime_error("unimplemented light type");
+			shadowRayHits[k] = i;
+			shadowRayQueue[k] = k;
 		}
+	}
+	std::stable_sort(shadowRayQueue.begin(), shadowRayQueue.end(), [&](unsigned int a, unsigned int b)
+	{
+		return shadowRayLights[a] < shadowRayLights[b];
+	});
+
+	const LightBuffer& rLights = mpSnapshot->GetLightBuffer();
+	std::vector<Vector3F> directionsToLights(numberOfShadowRays);
+	std::vector<float> distancesToLights(numberOfShadowRays);
+	std::vector<bool> lightsBlocked(numberOfShadowRays);
+	for (unsigned int k : shadowRayQueue)
+	{
+		const PathSegment& rSegment = rSegments[rHitQueue[shadowRayHits[k]]];
+		rLights.GetDirectionToLight(shadowRayLights[k], rSegment.attributes.point, directionsToLights[k], distancesToLights[k]);
+		lightsBlocked[k] = IsLightBlocked(rSegment.attributes, directionsToLights[k], distancesToLights[k], shadowRayLights[k], rSegment.sceneObjectIndex, rSegment.rayHit.primitive);
+	}
+
+	float zFar = mpSnapshot->GetCamera().zFar();
+	for (unsigned int i = 0; i < rHitQueue.size(); i++)
+	{
+		unsigned int segmentIndex = rHitQueue[i];
+		PathSegment& rSegment = rSegments[segmentIndex];
+		const Material& rMaterial = mpSnapshot->GetMaterial(rSegment.sceneObjectIndex);
+		Vector3F viewerDirection = (rSegment.ray.origin - rSegment.attributes.point).Normalized();
 
-		Ray shadowRay(rHit.point, directionToLight);
-		if (IsLightBlocked(shadowRay, distanceToLight, sceneObject))
+		LightAccumulator lightAccumulator(rLights, rSegment.attributes.normal, viewerDirection, DiffuseColor(rMaterial, rSegment.attributes), rMaterial.specularColor, rMaterial.shininess);
+		for (unsigned int k = shadowRayOffsets[i]; k < shadowRayOffsets[i + 1]; k++)
 		{
-			continue;
+			if (lightsBlocked[k])
+			{
+				continue;
+			}
+			lightAccumulator.Add(shadowRayLights[k], directionsToLights[k], distancesToLights[k]);
+		}
+		rSegment.color = lightAccumulator.Resolve();
+
+		// the segments spawned here go to the next queues. rSegment is invalidated by them
+		Vector3F point = rSegment.attributes.point;
+		unsigned int iteration = rSegment.iteration;
+		unsigned int sceneObjectIndex = rSegment.sceneObjectIndex;
+		unsigned int primitive = rSegment.rayHit.primitive;
+		RayMetadata* pRayMetadata = rSegment.pRayMetadata;
+		if (rMaterial.reflection > 0 || rMaterial.refraction > 0)
+		{
+			bool reflection = rMaterial.reflection > 0;
+			Vector3F direction = (reflection) ? ReflectionDirection(viewerDirection, rSegment.attributes.normal) : RefractionDirection(viewerDirection, rSegment.attributes.normal, rMaterial.refraction);
+			RayMetadata* pSecondaryRayMetadata = nullptr;
+			if (mCollectRayMetadata && pRayMetadata != nullptr)
+			{
+				pRayMetadata->next = std::unique_ptr<RayMetadata>(new RayMetadata());
+				pSecondaryRayMetadata = pRayMetadata->next.get();
+				pSecondaryRayMetadata->start = point;
+				pSecondaryRayMetadata->direction = direction;
+				pSecondaryRayMetadata->isReflection = reflection;
+				pSecondaryRayMetadata->isRefraction = !reflection;
+			}
+			// same cut-off as TraceRay
+			if (iteration + 1 <= MAX_ITERATIONS)
+			{
+				rSegment.secondary = static_cast<unsigned int>(rSegments.size());
+				Ray secondaryRay(Ray::OffsetOrigin(point, rSegment.attributes.normal, direction), direction, 0, zFar / direction.Length());
+				secondaryRay.SetOrigin(sceneObjectIndex, primitive);
+				rSegments.emplace_back(secondaryRay, iteration + 1, pSecondaryRayMetadata);
+			}
 		}
 
-		ColorRGBA diffuseColor = rMaterial.diffuseColor;
-		if (rMaterial.texture != 0)
+		if (rMaterial.transparent)
 		{
-			diffuseColor *= rMaterial.texture->Sample(rHit.uv);
+			PathSegment& rHitSegment = rSegments[segmentIndex];
+			rHitSegment.behind = static_cast<unsigned int>(rSegments.size());
+			Ray ray = rHitSegment.ray;
+			ray.tMin = rHitSegment.rayHit.t;
+			ray.SetOrigin(sceneObjectIndex, primitive);
+			rSegments.emplace_back(ray, iteration, nullptr);
 		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void RayTracer::ResolveSegment(std::vector<PathSegment>& rSegments, unsigned int segmentIndex) const
+{
+	// same composition as TraceSurface/Reflectance, with the recursive calls replaced by the already resolved children
+	PathSegment& rSegment = rSegments[segmentIndex];
+	if (!rSegment.hit)
+	{
+		rSegment.color = SimpleRayTracerApp::CLEAR_COLOR;
+		return;
+	}
 
-		ColorRGBA colorContribution = BlinnPhong(diffuseColor, rMaterial.specularColor, rMaterial.shininess, *light, directionToLight, viewerDirection, rNormal);
+	const Material& rMaterial = mpSnapshot->GetMaterial(rSegment.sceneObjectIndex);
+	ColorRGBA color = rSegment.color;
+	if (rMaterial.reflection > 0 || rMaterial.refraction > 0)
+	{
+		ColorRGBA secondaryColor = SimpleRayTracerApp::CLEAR_COLOR;
+		if (rSegment.secondary != PathSegment::NONE)
+		{
+			secondaryColor = mpSnapshot->GetAmbientLight() + rSegments[rSegment.secondary].color;
+		}
 
-		if (srt_is(light, PointLight))
+		if (rMaterial.reflection > 0)
+		{
+			color += rMaterial.reflection * secondaryColor;
+		}
+		else
 		{
-			float distanceAttenuation = 1.0f / (srt_dynPtrCast(light, PointLight)->attenuation * distanceToLight);
-			colorContribution *= distanceAttenuation;
+			color = color.Blend(secondaryColor);
 		}
+	}
+
+	srt_clampColor(color, 0, 1);
+
+	if (rMaterial.transparent)
+	{
+		color = color.Blend(rSegments[rSegment.behind].color);
+	}
+
+	rSegment.color = color;
+}
+
+//////////////////////////////////////////////////////////////////////////
+ColorRGBA RayTracer::TraceRay(const Ray& rRay, RayMetadata& rRayMetadata, float* pCurrentDepth, unsigned int iteration) const
+{
+	ColorRGBA finalColor = SimpleRayTracerApp::CLEAR_COLOR;
+
+	if (iteration > MAX_ITERATIONS)
+	{
+		return finalColor;
+	}
 
-		color += colorContribution;
+	// depths are distances along the ray, the scene is queried with ray parameters
+	float directionLength = rRay.direction.Length();
+	float tMax = *pCurrentDepth / directionLength;
+
+	float hitT = -1;
+	finalColor = TraceSurface(rRay, rRayMetadata, 0, tMax, &hitT, iteration);
+
+	if (hitT >= 0)
+	{
+		*pCurrentDepth = hitT * directionLength;
 	}
 
+	return mpSnapshot->GetAmbientLight() + finalColor;
+}
+
+//////////////////////////////////////////////////////////////////////////
+ColorRGBA RayTracer::TraceSurface(const Ray& rRay, RayMetadata& rRayMetadata, float tMin, float tMax, float* pHitT, unsigned int iteration) const
+{
+	Ray ray = rRay;
+	ray.tMin = tMin;
+	ray.tMax = tMax;
+
+	RayHit hit;
+	unsigned int sceneObjectIndex;
+	if (!mpSnapshot->Intersect(ray, hit, sceneObjectIndex))
+	{
+		return SimpleRayTracerApp::CLEAR_COLOR;
+	}
+
+	return ShadeSurface(rRay, rRayMetadata, hit, sceneObjectIndex, tMax, pHitT, iteration);
+}
+
+//////////////////////////////////////////////////////////////////////////
+ColorRGBA RayTracer::ShadeSurface(const Ray& rRay, RayMetadata& rRayMetadata, const RayHit& rHit, unsigned int sceneObjectIndex, float tMax, float* pHitT, unsigned int iteration) const
+{
+	const SceneObject* pSceneObject = mpSnapshot->GetSceneObject(sceneObjectIndex);
+
+	if (pHitT != nullptr)
+	{
+		*pHitT = rHit.t;
+	}
+
+	// attributes are only evaluated for the closest hit
+	HitAttributes attributes;
+	pSceneObject->EvaluateAttributes(rRay, rHit, attributes);
+
+	if (mCollectRayMetadata)
+		SetRayMetadataHitPoint(rRayMetadata, attributes.point);
+
+	ColorRGBA color = Reflectance(sceneObjectIndex, rHit.primitive, rRay, attributes, rRayMetadata, iteration);
+
+	// transparent surfaces are blended over the nearest surface behind them. the primitive hit is skipped,
+	// or its own far side (e.g., the back of a sphere) would hide whatever it's in front of
+	if (mpSnapshot->GetMaterial(sceneObjectIndex).transparent)
+	{
+		Ray behindRay = rRay;
+		behindRay.SetOrigin(sceneObjectIndex, rHit.primitive);
+		RayMetadata behindRayMetadata;
+		color = color.Blend(TraceSurface(behindRay, behindRayMetadata, rHit.t, tMax, nullptr, iteration));
+	}
+
+	return color;
+}
+
+//////////////////////////////////////////////////////////////////////////
+ColorRGBA RayTracer::Reflectance(unsigned int sceneObjectIndex, unsigned int primitive, const Ray &rRay, const HitAttributes& rHit, RayMetadata& rRayMetadata, unsigned int iteration) const
+{
+	const Material& rMaterial = mpSnapshot->GetMaterial(sceneObjectIndex);
+	const Camera& rCamera = mpSnapshot->GetCamera();
+
+	Vector3F viewerDirection = (rRay.origin - rHit.point).Normalized();
+	const Vector3F& rNormal = rHit.normal;
+
+	const LightBuffer& rLights = mpSnapshot->GetLightBuffer();
+	LightAccumulator lightAccumulator(rLights, rNormal, viewerDirection, DiffuseColor(rMaterial, rHit), rMaterial.specularColor, rMaterial.shininess);
+	mpSnapshot->ForEachLight(rHit.point, [&](unsigned int j)
+	{
+		Vector3F directionToLight;
+		float distanceToLight;
+		rLights.GetDirectionToLight(j, rHit.point, directionToLight, distanceToLight);
+
+		if (IsLightBlocked(rHit, directionToLight, distanceToLight, j, sceneObjectIndex, primitive))
+		{
+			return;
+		}
+
+		lightAccumulator.Add(j, directionToLight, distanceToLight);
+	});
+	ColorRGBA color = lightAccumulator.Resolve();
+
 	if (rMaterial.reflection > 0)
 	{
-		Vector3F reflectionDirection = (-viewerDirection).Reflection(rNormal).Normalized();
-		Ray reflectionRay(rHit.point, reflectionDirection);
-		float newDepth = camera->zFar();
+		Vector3F reflectionDirection = ReflectionDirection(viewerDirection, rNormal);
+		Ray reflectionRay(Ray::OffsetOrigin(rHit.point, rNormal, reflectionDirection), reflectionDirection);
+		reflectionRay.SetOrigin(sceneObjectIndex, primitive);
+		float newDepth = rCamera.zFar();
 		std::unique_ptr<RayMetadata> reflectionRayMetadata;
 		if (mCollectRayMetadata)
 		{
@@ -393,21 +853,17 @@ ColorRGBA RayTracer::Reflectance(std::shared_ptr<SceneObject>& sceneObject, cons
 			reflectionRayMetadata->direction = reflectionDirection;
 			reflectionRayMetadata->isReflection = true;
 		}
-		color += rMaterial.reflection * TraceRay(reflectionRay, *reflectionRayMetadata, &newDepth, iteration + 1, sceneObject);
+		color += rMaterial.reflection * TraceRay(reflectionRay, *reflectionRayMetadata, &newDepth, iteration + 1);
 		if (mCollectRayMetadata)
 			rRayMetadata.next = std::move(reflectionRayMetadata);
 	}
 	else if (rMaterial.refraction > 0)
 	{
-		Vector3F rVt = viewerDirection.Dot(rNormal) * rNormal - viewerDirection;
-		float sinI = rVt.Length();
-		float sinT = rMaterial.refraction * sinI;
-		float cosT = sqrt(1.0f - (sinT * sinT));
-		Vector3F rT = (1.0f / rVt.Length()) * rVt;
-		Vector3F rRefractionDirection = sinT * rT + cosT * (-rNormal);
+		Vector3F rRefractionDirection = RefractionDirection(viewerDirection, rNormal, rMaterial.refraction);
 
-		Ray refractionRay(rHit.point, rRefractionDirection);
-		float newDepth = camera->zFar();
+		Ray refractionRay(Ray::OffsetOrigin(rHit.point, rNormal, rRefractionDirection), rRefractionDirection);
+		refractionRay.SetOrigin(sceneObjectIndex, primitive);
+		float newDepth = rCamera.zFar();
 		std::unique_ptr<RayMetadata> refractionRayMetadata;
 		if (mCollectRayMetadata)
 		{
@@ -416,7 +872,7 @@ ColorRGBA RayTracer::Reflectance(std::shared_ptr<SceneObject>& sceneObject, cons
 			refractionRayMetadata->direction = rRefractionDirection;
 			refractionRayMetadata->isRefraction = true;
 		}
-		color = color.Blend(TraceRay(refractionRay, *refractionRayMetadata, &newDepth, iteration + 1, sceneObject));
+		color = color.Blend(TraceRay(refractionRay, *refractionRayMetadata, &newDepth, iteration + 1));
 		if (mCollectRayMetadata)
 			rRayMetadata.next = std::move(refractionRayMetadata);
 	}
@@ -427,47 +883,60 @@ ColorRGBA RayTracer::Reflectance(std::shared_ptr<SceneObject>& sceneObject, cons
 }
 
 //////////////////////////////////////////////////////////////////////////
-bool RayTracer::IsLightBlocked(const Ray& rShadowRay, float distanceToLight, std::shared_ptr<SceneObject> origin) const
+ColorRGBA RayTracer::DiffuseColor(const Material& rMaterial, const HitAttributes& rHit) const
 {
-	for (unsigned int i = 0; i < mScene->NumberOfSceneObjects(); i++)
+	// the texture is sampled once per hit, not once per light
+	ColorRGBA diffuseColor = rMaterial.diffuseColor;
+	if (rMaterial.texture != 0)
 	{
-		if (auto sceneObject = mScene->GetSceneObject(i).lock())
-		{
-			if (sceneObject == origin)
-			{
-				continue;
-			}
-
-			RayHit hit;
-			if (sceneObject->Intersect(rShadowRay, hit))
-			{
-				if (distanceToLight == -1)
-				{
-					return true;
-				}
-				else if (distanceToLight > hit.point.Distance(rShadowRay.origin))
-				{
-					return true;
-				}
-			}
-		}
+		diffuseColor *= rMaterial.texture->Sample(rHit.uv);
 	}
+	return diffuseColor;
+}
 
-	return false;
+//////////////////////////////////////////////////////////////////////////
+Vector3F RayTracer::ReflectionDirection(const Vector3F& rViewerDirection, const Vector3F& rNormal) const
+{
+	return (-rViewerDirection).Reflection(rNormal).Normalized();
 }
 
 //////////////////////////////////////////////////////////////////////////
-ColorRGBA RayTracer::BlinnPhong(const ColorRGBA& rMaterialDiffuseColor, const ColorRGBA& rMaterialSpecularColor, float materialShininess, const Light& rLight, const Vector3F& L, const Vector3F& V, const Vector3F& N) const
+Vector3F RayTracer::RefractionDirection(const Vector3F& rViewerDirection, const Vector3F& rNormal, float refraction) const
 {
-	float NdotL = max(N.Dot(L), 0);
-	ColorRGBA specular;
-	if (NdotL > 0)
+	Vector3F rVt = rViewerDirection.Dot(rNormal) * rNormal - rViewerDirection;
+	float sinI = rVt.Length();
+	float sinT = refraction * sinI;
+	float cosT = sqrt(1.0f - (sinT * sinT));
+	Vector3F rT = (1.0f / rVt.Length()) * rVt;
+	return sinT * rT + cosT * (-rNormal);
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool RayTracer::IsLightBlocked(const HitAttributes& rHit, const Vector3F& rDirectionToLight, float distanceToLight, unsigned int lightIndex, unsigned int sceneObjectIndex, unsigned int primitive) const
+{
+	// shadow rays are normalized, so ray parameters are distances (-1 means the light is infinitely far away).
+	// they leave from the primitive that was hit, which is the only one they skip
+	Ray shadowRay(Ray::OffsetOrigin(rHit.point, rHit.normal, rDirectionToLight), rDirectionToLight, 0, (distanceToLight == -1) ? FLT_MAX : distanceToLight);
+	shadowRay.SetOrigin(sceneObjectIndex, primitive);
+
+	// neighbouring points are usually shadowed by the same primitive, so the last one that blocked this light is tried
+	// before traversing the scene. it's kept when the ray gets through, as the next point may be in its shadow again
+	if (lightIndex >= s_mOccluderCache.size())
+	{
+		s_mOccluderCache.resize(lightIndex + 1);
+	}
+	Occluder& rOccluder = s_mOccluderCache[lightIndex];
+	if (rOccluder.sceneObject != UINT_MAX && rOccluder.generation == mpSnapshot->GetGeneration())
 	{
-		Vector3F H = (L + V).Normalized();
-		float NdotH = N.Dot(H);
-		specular = rLight.intensity * rLight.specularColor * rMaterialSpecularColor * pow(max(NdotH, 0), materialShininess);
+		s_mShadowCacheStatistics.lookups++;
+		if (mpSnapshot->IsOccludedBy(shadowRay, rOccluder))
+		{
+			s_mShadowCacheStatistics.hits++;
+			return true;
+		}
 	}
-	return (rLight.intensity * rLight.diffuseColor * rMaterialDiffuseColor * NdotL + specular);
+
+	return mpSnapshot->IsOccluded(shadowRay, &rOccluder);
 }
 
 
@@ -6,10 +6,31 @@
 
 #include "Renderer.h"
 #include "Scene.h"
+#include "RenderSnapshot.h"
 #include "Ray.h"
+#include "RayHit.h"
+#include "Occluder.h"
 #include "SceneObject.h"
 #include "ColorRGBA.h"
 #include "RayMetadata.h"
+#include "HitAttributes.h"
+#include "PathSegment.h"
+#include "TileScheduler.h"
+
+struct ShadowCacheStatistics
+{
+	// shadow rays tested against the last occluder of their light first
+	unsigned long long lookups;
+	// lookups that were blocked by it, and so skipped the traversal
+	unsigned long long hits;
+
+	ShadowCacheStatistics() :
+		lookups(0),
+		hits(0)
+	{
+	}
+
+};
 
 class RayTracer : public Renderer
 {
@@ -32,6 +53,17 @@ public:
 		mDebug = debug;
 	}
 
+	inline bool WavefrontEnabled() const
+	{
+		return mWavefront;
+	}
+
+	// traces each tile breadth first (every ray of a kind at once) instead of recursing per pixel. the image is the same
+	inline void SetWavefront(bool wavefront)
+	{
+		mWavefront = wavefront;
+	}
+
 	inline bool CollectRayMetadataEnabled() const
 	{
 		return mCollectRayMetadata;
@@ -42,6 +74,53 @@ public:
 		mCollectRayMetadata = collectRayMetadata;
 	}
 
+	// side of the square packets primary rays are traced in (2, 4 or 8), 1 traces every primary ray alone
+	inline unsigned int GetPacketSize() const
+	{
+		return mPacketSize;
+	}
+
+	void SetPacketSize(unsigned int packetSize);
+
+	// side of the square tiles the frame is split into. each tile is traced start to end by a single thread.
+	// tiles that turn out expensive are split for the next frame
+	inline unsigned int GetTileSize() const
+	{
+		return mTileSize;
+	}
+
+	void SetTileSize(unsigned int tileSize);
+
+	// threads tracing the tiles of a frame, the calling one included. they come from the task scheduler pool, so there are
+	// never more of them than it has. 0 uses all of them
+	inline unsigned int GetNumberOfThreads() const
+	{
+		return mNumberOfThreads;
+	}
+
+	inline void SetNumberOfThreads(unsigned int numberOfThreads)
+	{
+		mNumberOfThreads = numberOfThreads;
+	}
+
+	// tiling and load balance of the last frame
+	inline const TileSchedulerStatistics& GetTileStatistics() const
+	{
+		return mTileScheduler.GetStatistics();
+	}
+
+	// occluder cache counters of the calling thread. the ones of the threads tracing a frame are added to the thread that
+	// called TraceRays, as are their BVH counters
+	static inline ShadowCacheStatistics& GetShadowCacheStatistics()
+	{
+		return s_mShadowCacheStatistics;
+	}
+
+	static inline void ResetShadowCacheStatistics()
+	{
+		s_mShadowCacheStatistics = ShadowCacheStatistics();
+	}
+
 	virtual void Start();
 	virtual void Render();
 
@@ -54,6 +133,10 @@ private:
 	static const unsigned int RAYS_METADATA_SIZE;
 	static const unsigned int MAX_ITERATIONS;
 
+	// last occluder of the shadow rays towards each light, per thread
+	static thread_local std::vector<Occluder> s_mOccluderCache;
+	static thread_local ShadowCacheStatistics s_mShadowCacheStatistics;
+
 	std::unique_ptr<RayMetadata[]> mpRaysMetadata;
 	unsigned int mTextureId;
 	unsigned int mPBOId;
@@ -62,14 +145,34 @@ private:
 	std::unique_ptr<float[]> mpDepthBuffer;
 	bool mDebug;
 	bool mCollectRayMetadata;
+	bool mWavefront;
+	unsigned int mPacketSize;
+	unsigned int mTileSize;
+	unsigned int mNumberOfThreads;
+	TileScheduler mTileScheduler;
+	// snapshot generation the tile costs were measured in
+	unsigned int mTileCostsGeneration;
+	// set by TraceRays for the frame being traced
+	const RenderSnapshot* mpSnapshot;
 
 	void TraceRays(std::unique_ptr<unsigned char[]>& colorBuffer);
+	void TraceTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, std::unique_ptr<unsigned char[]>& colorBuffer);
+	void TracePacket(unsigned int x0, unsigned int y0, unsigned int width, unsigned int height, std::unique_ptr<unsigned char[]>& colorBuffer);
+	void TraceTileWavefront(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, std::unique_ptr<unsigned char[]>& colorBuffer);
+	void SortQueue(const std::vector<PathSegment>& rSegments, std::vector<unsigned int>& rQueue) const;
+	void IntersectQueue(std::vector<PathSegment>& rSegments, const std::vector<unsigned int>& rQueue, std::vector<unsigned int>& rHitQueue) const;
+	void ShadeQueue(std::vector<PathSegment>& rSegments, std::vector<unsigned int>& rHitQueue) const;
+	void ResolveSegment(std::vector<PathSegment>& rSegments, unsigned int segmentIndex) const;
 	void ResetRayMetadata(RayMetadata& rRayMetadata, const Vector3F& rRayOrigin, const Vector3F& rRayDirection);
 	void SetRayMetadataHitPoint(RayMetadata& rayMetadata, const Vector3F& hitPoint) const;
-	ColorRGBA TraceRay(const Ray& rRay, RayMetadata& rRayMetadata, float* pCurrentDepth, unsigned int iteration, std::shared_ptr<SceneObject> pIgnoreSceneObject = std::shared_ptr<SceneObject>(nullptr)) const;
-	ColorRGBA Reflectance(std::shared_ptr<SceneObject>& sceneObject, const Ray& rRay, const RayHit& rHit, RayMetadata& rRayMetadata, unsigned int iteration) const;
-	bool IsLightBlocked(const Ray& rShadowRay, float distanceToLight, std::shared_ptr<SceneObject> origin) const;
-	ColorRGBA BlinnPhong(const ColorRGBA& rMaterialDiffuseColor, const ColorRGBA& rMaterialSpecularColor, float materialShininess, const Light& rLight, const Vector3F& rLightDirection, const Vector3F& rViewerDirection, const Vector3F& rNormal) const;
+	ColorRGBA TraceRay(const Ray& rRay, RayMetadata& rRayMetadata, float* pCurrentDepth, unsigned int iteration) const;
+	ColorRGBA TraceSurface(const Ray& rRay, RayMetadata& rRayMetadata, float tMin, float tMax, float* pHitT, unsigned int iteration) const;
+	ColorRGBA ShadeSurface(const Ray& rRay, RayMetadata& rRayMetadata, const RayHit& rHit, unsigned int sceneObjectIndex, float tMax, float* pHitT, unsigned int iteration) const;
+	ColorRGBA Reflectance(unsigned int sceneObjectIndex, unsigned int primitive, const Ray& rRay, const HitAttributes& rHit, RayMetadata& rRayMetadata, unsigned int iteration) const;
+	ColorRGBA DiffuseColor(const Material& rMaterial, const HitAttributes& rHit) const;
+	Vector3F ReflectionDirection(const Vector3F& rViewerDirection, const Vector3F& rNormal) const;
+	Vector3F RefractionDirection(const Vector3F& rViewerDirection, const Vector3F& rNormal, float refraction) const;
+	bool IsLightBlocked(const HitAttributes& rHit, const Vector3F& rDirectionToLight, float distanceToLight, unsigned int lightIndex, unsigned int sceneObjectIndex, unsigned int primitive) const;
 	
 };
 
@@ -0,0 +1,299 @@
+#ifndef RENDERSNAPSHOT_H_
+#define RENDERSNAPSHOT_H_
+
+#include <vector>
+#include <memory>
+#include <cfloat>
+
+#include "Accelerator.h"
+#include "AABB.h"
+#include "BVH.h"
+#include "Camera.h"
+#include "Light.h"
+#include "LightBuffer.h"
+#include "PointLight.h"
+#include "Material.h"
+#include "Occluder.h"
+#include "Ray.h"
+#include "RayHit.h"
+#include "RayPacket.h"
+#include "SceneObject.h"
+#include "Vector3F.h"
+#include "ColorRGBA.h"
+
+// read-only view of a scene for one frame, compiled by Scene::Update. everything the tracer needs is kept in flat arrays
+// of raw pointers and indices, so tracing never touches the reference counts of the scene graph (shared/weak pointers).
+// it points into the scene, so it's only valid until the next update and as long as the scene is alive
+class RenderSnapshot
+{
+public:
+	RenderSnapshot() :
+		mpCamera(nullptr),
+		mpAccelerator(nullptr),
+		mGeneration(0)
+	{
+	}
+
+	~RenderSnapshot() = default;
+
+	void Compile(const Camera& rCamera, const ColorRGBA& rAmbientLight, const std::vector<std::unique_ptr<Light>>& rLights, float lightCutoff, const std::vector<std::shared_ptr<SceneObject>>& rSceneObjects, const Accelerator& rAccelerator)
+	{
+		mpCamera = &rCamera;
+		mAmbientLight = rAmbientLight;
+		mpAccelerator = &rAccelerator;
+
+		// scene object indices only keep their meaning while the list of objects stays the same
+		bool sceneObjectsChanged = (mGeneration == 0 || mSceneObjects.size() != rSceneObjects.size());
+		mSceneObjects.resize(rSceneObjects.size());
+		mMaterials.resize(rSceneObjects.size());
+		for (unsigned int i = 0; i < rSceneObjects.size(); i++)
+		{
+			sceneObjectsChanged |= (mSceneObjects[i] != rSceneObjects[i].get());
+			mSceneObjects[i] = rSceneObjects[i].get();
+			mMaterials[i] = &rSceneObjects[i]->material;
+		}
+		if (sceneObjectsChanged)
+		{
+			mGeneration = NextGeneration();
+		}
+
+		CompileLights(rLights, lightCutoff);
+	}
+
+	inline const Camera& GetCamera() const
+	{
+		return *mpCamera;
+	}
+
+	inline const ColorRGBA& GetAmbientLight() const
+	{
+		return mAmbientLight;
+	}
+
+	// changes whenever the scene objects (and so their indices) change, never repeats across snapshots
+	inline unsigned int GetGeneration() const
+	{
+		return mGeneration;
+	}
+
+	inline unsigned int NumberOfSceneObjects() const
+	{
+		return static_cast<unsigned int>(mSceneObjects.size());
+	}
+
+	inline const SceneObject* GetSceneObject(unsigned int i) const
+	{
+		return mSceneObjects[i];
+	}
+
+	// material of a scene object
+	inline const Material& GetMaterial(unsigned int i) const
+	{
+		return *mMaterials[i];
+	}
+
+	inline const LightBuffer& GetLightBuffer() const
+	{
+		return mLightBuffer;
+	}
+
+	// visits the index of every light that may reach a point: the ones without an influence radius first, then the ones
+	// whose influence sphere contains the point. without a light cutoff that's every light, in order
+	template <typename VisitLight>
+	void ForEachLight(const Vector3F& rPoint, VisitLight visitLight) const
+	{
+		for (unsigned int i : mUnboundedLights)
+		{
+			visitLight(i);
+		}
+
+		mLightBVH.TraversePoint(rPoint, [&](unsigned int i)
+		{
+			const LightInfluence& rInfluence = mLightInfluences[i];
+			Vector3F delta = rPoint - rInfluence.center;
+			if (delta.Dot(delta) <= rInfluence.radius * rInfluence.radius)
+			{
+				visitLight(rInfluence.light);
+			}
+		});
+	}
+
+	// closest hit in (rRay.tMin, rRay.tMax) against every primitive but the one the ray starts on. rRay.tMax is shrunk to the hit
+	bool Intersect(const Ray& rRay, RayHit& rHit, unsigned int& rSceneObjectIndex) const
+	{
+		bool hasHit = false;
+		return mpAccelerator->Traverse(rRay, [&](unsigned int i)
+		{
+			// objects only report hits inside the interval, and shrink it to them
+			float tMax = rRay.tMax;
+			RayHit hit;
+			if (!mSceneObjects[i]->Intersect(rRay, hit, rRay.IgnoredPrimitive(i)))
+			{
+				return false;
+			}
+
+			// ties go to the first scene object so that the result doesn't depend on the traversal order
+			if (hit.t == tMax && (!hasHit || i > rSceneObjectIndex))
+			{
+				return false;
+			}
+			hasHit = true;
+
+			rHit = hit;
+			rSceneObjectIndex = i;
+			return true;
+		});
+	}
+
+	// closest hit of every ray of rayMask in a packet, in (0, rPacket.tMax]. rPacket.tMax is shrunk to the hit distances.
+	// fills pHits and pSceneObjectIndices for the rays hit and returns their mask
+	unsigned long long IntersectPacket(RayPacket& rPacket, unsigned long long rayMask, RayHit* pHits, unsigned int* pSceneObjectIndices) const
+	{
+		unsigned long long hasHit = 0;
+		RayHit hits[RayPacket::MAX_SIZE];
+		mpAccelerator->TraversePacket(rPacket, rayMask, [&](unsigned int i, unsigned long long objectRayMask)
+		{
+			const SceneObject* pSceneObject = mSceneObjects[i];
+			unsigned long long objectHits;
+			if ((objectRayMask & (objectRayMask - 1)) == 0)
+			{
+				// lone rays (e.g., from indices that trace packets ray by ray) skip the packet setup
+				unsigned int j = RayPacket::FirstRay(objectRayMask);
+				Ray ray = rPacket.GetRay(j);
+				objectHits = (pSceneObject->Intersect(ray, hits[j], Ray::NO_ORIGIN)) ? objectRayMask : 0;
+			}
+			else
+			{
+				objectHits = pSceneObject->IntersectPacket(rPacket, objectRayMask, hits);
+			}
+
+			unsigned long long closerHits = 0;
+			for (; objectHits != 0; objectHits &= objectHits - 1)
+			{
+				unsigned int j = RayPacket::FirstRay(objectHits);
+				const RayHit& rHit = hits[j];
+				if (rHit.t <= 0 || rHit.t > rPacket.tMax[j])
+				{
+					continue;
+				}
+
+				// same tie-break as Intersect
+				unsigned long long ray = RayPacket::Bit(j);
+				if (rHit.t == rPacket.tMax[j] && ((hasHit & ray) == 0 || i > pSceneObjectIndices[j]))
+				{
+					continue;
+				}
+				hasHit |= ray;
+				closerHits |= ray;
+
+				rPacket.tMax[j] = rHit.t;
+				pHits[j] = rHit;
+				pSceneObjectIndices[j] = i;
+			}
+			return closerHits;
+		});
+		return hasHit;
+	}
+
+	// true as soon as any primitive but the one the ray starts on is hit in (rRay.tMin, rRay.tMax). pOccluder, if any,
+	// receives what was hit
+	bool IsOccluded(const Ray& rRay, Occluder* pOccluder = nullptr) const
+	{
+		return mpAccelerator->Traverse(rRay, [&](unsigned int i)
+		{
+			unsigned int primitive;
+			if (!mSceneObjects[i]->Occluded(rRay, rRay.IgnoredPrimitive(i), primitive))
+			{
+				return false;
+			}
+
+			if (pOccluder != nullptr)
+			{
+				pOccluder->sceneObject = i;
+				pOccluder->primitive = primitive;
+				pOccluder->generation = mGeneration;
+			}
+			return true;
+		}, true);
+	}
+
+	// same as IsOccluded, but only against the primitive of a previous occluder and without traversing the scene.
+	// occluders recorded in another generation are never tested, their indices may point at unrelated objects
+	bool IsOccludedBy(const Ray& rRay, const Occluder& rOccluder) const
+	{
+		if (rOccluder.generation != mGeneration || rOccluder.sceneObject >= mSceneObjects.size() || rRay.IgnoredPrimitive(rOccluder.sceneObject) == rOccluder.primitive)
+		{
+			return false;
+		}
+
+		return mSceneObjects[rOccluder.sceneObject]->PrimitiveOccluded(rRay, rOccluder.primitive);
+	}
+
+private:
+	struct LightInfluence
+	{
+		unsigned int light;
+		Vector3F center;
+		float radius;
+	};
+
+	const Camera* mpCamera;
+	ColorRGBA mAmbientLight;
+	const Accelerator* mpAccelerator;
+	// indexed by scene object (the primitives of the accelerator)
+	std::vector<const SceneObject*> mSceneObjects;
+	std::vector<const Material*> mMaterials;
+	LightBuffer mLightBuffer;
+	// lights that reach every point, and the influence spheres of the others (the primitives of mLightBVH)
+	std::vector<unsigned int> mUnboundedLights;
+	std::vector<LightInfluence> mLightInfluences;
+	BVH mLightBVH;
+	unsigned int mGeneration;
+
+	// snapshots are only compiled by the thread updating the scenes
+	static unsigned int NextGeneration()
+	{
+		static unsigned int s_nextGeneration = 0;
+		return ++s_nextGeneration;
+	}
+
+	void CompileLights(const std::vector<std::unique_ptr<Light>>& rLights, float lightCutoff)
+	{
+		mLightBuffer.Build(rLights);
+
+		mUnboundedLights.clear();
+		mLightInfluences.clear();
+		std::vector<AABB> influenceBounds;
+		for (unsigned int i = 0; i < rLights.size(); i++)
+		{
+			const PointLight* pPointLight = (mLightBuffer.types[i] == LT_POINT) ? static_cast<const PointLight*>(rLights[i].get()) : nullptr;
+			float radius = (pPointLight != nullptr) ? pPointLight->InfluenceRadius(lightCutoff) : FLT_MAX;
+			if (radius == FLT_MAX)
+			{
+				mUnboundedLights.push_back(i);
+				continue;
+			}
+
+			LightInfluence influence;
+			influence.light = i;
+			influence.center = pPointLight->position;
+			influence.radius = radius;
+			mLightInfluences.push_back(influence);
+			influenceBounds.push_back(AABB(influence.center - radius, influence.center + radius));
+		}
+
+		if (influenceBounds.empty())
+		{
+			mLightBVH.Clear();
+			return;
+		}
+
+		// point queries only run on the binary tree, so it isn't collapsed into wide nodes
+		BVHSettings settings;
+		settings.width = 2;
+		mLightBVH.Update(influenceBounds, settings);
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -4,8 +4,11 @@
 #include <vector>
 #include <memory>
 
+#include "Accelerator.h"
+#include "BVHAccelerator.h"
 #include "Camera.h"
 #include "Light.h"
+#include "RenderSnapshot.h"
 #include "SceneObject.h"
 #include "ColorRGBA.h"
 
@@ -13,9 +16,13 @@ class Scene
 {
 public:
 	ColorRGBA ambientLight;
+	// point lights are culled past the distance where they add less than this to any color channel, 0 never culls them
+	float lightCutoff;
 
 	Scene() :
-	  mCamera(nullptr)
+	  lightCutoff(0),
+	  mCamera(nullptr),
+	  mAccelerator(new BVHAccelerator())
 	{
 	}
 
@@ -23,6 +30,7 @@ public:
 	{
 		mLights.clear();
 		mSceneObjects.clear();
+		mAccelerator->Clear();
 		mCamera = nullptr;
 	}
 
@@ -31,6 +39,16 @@ public:
 		mCamera = std::move(camera);
 	}
 
+	inline void SetAccelerator(std::unique_ptr<Accelerator>& accelerator)
+	{
+		mAccelerator = std::move(accelerator);
+	}
+
+	inline const std::unique_ptr<Accelerator>& GetAccelerator() const
+	{
+		return mAccelerator;
+	}
+
 	inline std::unique_ptr<Camera>& GetCamera()
 	{
 		return mCamera;
@@ -71,6 +89,12 @@ public:
 		return mSceneObjects[i];
 	}
 
+	// what tracing needs from the scene as of the last Update
+	inline const RenderSnapshot& GetSnapshot() const
+	{
+		return mSnapshot;
+	}
+
 	void Update()
 	{
 		mCamera->Update();
@@ -79,12 +103,27 @@ public:
 		{
 			mSceneObjects[i]->Update();
 		}
+
+		UpdateAccelerator();
+		mSnapshot.Compile(*mCamera, ambientLight, mLights, lightCutoff, mSceneObjects, *mAccelerator);
 	}
 
 private:
 	std::unique_ptr<Camera> mCamera;
 	std::vector<std::unique_ptr<Light>> mLights;
 	std::vector<std::shared_ptr<SceneObject>> mSceneObjects;
+	std::unique_ptr<Accelerator> mAccelerator;
+	RenderSnapshot mSnapshot;
+
+	void UpdateAccelerator()
+	{
+		std::vector<AABB> sceneObjectBounds(mSceneObjects.size());
+		for (unsigned int i = 0; i < mSceneObjects.size(); i++)
+		{
+			sceneObjectBounds[i] = mSceneObjects[i]->GetWorldBounds();
+		}
+		mAccelerator->Update(sceneObjectBounds);
+	}
 
 };
 
@@ -9,6 +9,7 @@
 #include "PointLight.h"
 #include "DirectionalLight.h"
 #include "Sphere.h"
+#include "SphereSet.h"
 #include "Mesh.h"
 #include "Texture.h"
 #include "TextureLoader.h"
@@ -16,6 +17,9 @@
 #include "BoundingSphere.h"
 #include "OBB.h"
 #include "ModelLoader.h"
+#include "BVHAccelerator.h"
+#include "UniformGrid.h"
+#include "KdTree.h"
 
 //////////////////////////////////////////////////////////////////////////
 std::unique_ptr<Scene> SceneLoader::LoadFromXML(const std::string& fileName)
@@ -38,6 +42,7 @@ std::unique_ptr<Scene> SceneLoader::LoadFromXML(const std::string& fileName)
 	std::unique_ptr<Scene> scene(new Scene());
 	std::map<int, std::shared_ptr<SceneObject> > sceneObjects;
 	std::map<int, int> sceneObjectParenting;
+	std::map<std::string, std::shared_ptr<MeshGeometry> > meshGeometries;
 	auto* root = doc.first_node();
 	if (root && strcmp("Scene", root->name()) == 0)
 	{
@@ -46,9 +51,16 @@ std::unique_ptr<Scene> SceneLoader::LoadFromXML(const std::string& fileName)
 			scene->ambientLight = GetColorRGBA(root, "ambientLight");
 		}
 
+		if (HasValue(root, "lightCutoff"))
+		{
+			scene->lightCutoff = GetFloat(root, "lightCutoff");
+		}
+
+		ParseAccelerator(scene, root);
+
 		for (auto* child = root->first_node(); child; child = child->next_sibling())
 		{
-			Traverse(scene, sceneObjects, sceneObjectParenting, child);
+			Traverse(scene, sceneObjects, sceneObjectParenting, meshGeometries, child);
 		}
 
 		auto it = sceneObjects.begin();
@@ -75,7 +87,41 @@ std::unique_ptr<Scene> SceneLoader::LoadFromXML(const std::string& fileName)
 }
 
 //////////////////////////////////////////////////////////////////////////
-void SceneLoader::Traverse(std::unique_ptr<Scene>& scene, std::map<int, std::shared_ptr<SceneObject> >& sceneObjects, std::map<int, int>& sceneObjectParenting, rapidxml::xml_node<>* xmlNode)
+void SceneLoader::ParseAccelerator(std::unique_ptr<Scene>& scene, rapidxml::xml_node<>* xmlNode)
+{
+	std::string type = (HasValue(xmlNode, "accelerator")) ? GetValue(xmlNode, "accelerator") : "bvh";
+
+	std::unique_ptr<Accelerator> accelerator;
+	if (type == "bvh")
+	{
+		BVHSettings settings;
+		ParseBVHSettings(xmlNode, settings);
+		// only the scene-level hierarchy is refitted, as objects move
+		if (HasValue(xmlNode, "bvhRebuildThreshold"))
+		{
+			settings.rebuildThreshold = GetFloat(xmlNode, "bvhRebuildThreshold");
+		}
+		accelerator = std::unique_ptr<Accelerator>(new BVHAccelerator(settings));
+	}
+	else if (type == "grid")
+	{
+		float density = (HasValue(xmlNode, "gridDensity")) ? GetFloat(xmlNode, "gridDensity") : UniformGrid::DEFAULT_DENSITY;
+		accelerator = std::unique_ptr<Accelerator>(new UniformGrid(density));
+	}
+	else if (type == "kdtree")
+	{
+		accelerator = std::unique_ptr<Accelerator>(new KdTree());
+	}
+	else
+	{
+		throw std::runtime_error("unknown accelerator type: " + type);
+	}
+
+	scene->SetAccelerator(accelerator);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SceneLoader::Traverse(std::unique_ptr<Scene>& scene, std::map<int, std::shared_ptr<SceneObject> >& sceneObjects, std::map<int, int>& sceneObjectParenting, std::map<std::string, std::shared_ptr<MeshGeometry> >& meshGeometries, rapidxml::xml_node<>* xmlNode)
 {
 	if (strcmp("Camera", xmlNode->name()) == 0)
 	{
@@ -89,9 +135,13 @@ void SceneLoader::Traverse(std::unique_ptr<Scene>& scene, std::map<int, std::sha
 	{
 		ParseSphere(scene, sceneObjects, sceneObjectParenting, xmlNode);
 	}
+	else if (strcmp("SphereSet", xmlNode->name()) == 0)
+	{
+		ParseSphereSet(sceneObjects, sceneObjectParenting, xmlNode);
+	}
 	else if (strcmp("Mesh", xmlNode->name()) == 0)
 	{
-		ParseMesh(scene, sceneObjects, sceneObjectParenting, xmlNode);
+		ParseMesh(scene, sceneObjects, sceneObjectParenting, meshGeometries, xmlNode);
 	}
 }
 
@@ -161,18 +211,90 @@ void SceneLoader::ParseSphere(std::unique_ptr<Scene>& scene, std::map<int, std::
 }
 
 //////////////////////////////////////////////////////////////////////////
-void SceneLoader::ParseMesh(std::unique_ptr<Scene>& scene, std::map<int, std::shared_ptr<SceneObject> >& sceneObjects, std::map<int, int>& sceneObjectParenting, rapidxml::xml_node<>* xmlNode)
+void SceneLoader::ParseSphereSet(std::map<int, std::shared_ptr<SceneObject> >& sceneObjects, std::map<int, int>& sceneObjectParenting, rapidxml::xml_node<>* xmlNode)
 {
-	std::shared_ptr<Mesh> mesh;
+	std::shared_ptr<SphereSet> sphereSet(new SphereSet());
 
 	int id = GetInt(xmlNode, "id");
 	int parentId = GetInt(xmlNode, "parentId");
 
 	sceneObjectParenting[id] = parentId;
 
-	if (HasValue(xmlNode, "obj"))
+	// spheres come from a file ("x, y, z, radius" per line) and/or from Sphere children
+	if (HasValue(xmlNode, "spheres"))
 	{
-		mesh = ModelLoader::LoadObj(GetValue(xmlNode, "obj"));
+		std::vector<Vector4F> spheres;
+		ReadFileToVector(GetValue(xmlNode, "spheres"), spheres);
+		for (auto& rSphere : spheres)
+		{
+			sphereSet->centers.push_back(Vector3F(rSphere.x(), rSphere.y(), rSphere.z()));
+			sphereSet->radii.push_back(rSphere.w());
+		}
+	}
+
+	ParseBVHSettings(xmlNode, sphereSet->bvhSettings);
+
+	for (rapidxml::xml_node<>* pChild = xmlNode->first_node(); pChild; pChild = pChild->next_sibling())
+	{
+		if (strcmp("Sphere", pChild->name()) == 0)
+		{
+			sphereSet->centers.push_back(GetVector3F(pChild, "center"));
+			sphereSet->radii.push_back(GetFloat(pChild, "radius"));
+		}
+		else if (strcmp("Transform", pChild->name()) == 0)
+		{
+			ParseTransform(pChild, sphereSet->localTransform);
+		}
+		else if (strcmp("Material", pChild->name()) == 0)
+		{
+			ParseMaterial(pChild, sphereSet->material);
+		}
+	}
+
+	sceneObjects[id] = sphereSet;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SceneLoader::ParseMesh(std::unique_ptr<Scene>& scene, std::map<int, std::shared_ptr<SceneObject> >& sceneObjects, std::map<int, int>& sceneObjectParenting, std::map<std::string, std::shared_ptr<MeshGeometry> >& meshGeometries, rapidxml::xml_node<>* xmlNode)
+{
+	std::shared_ptr<MeshGeometry> geometry;
+
+	int id = GetInt(xmlNode, "id");
+	int parentId = GetInt(xmlNode, "parentId");
+
+	sceneObjectParenting[id] = parentId;
+
+	bool newGeometry = false;
+	if (HasValue(xmlNode, "instanceOf"))
+	{
+		// shares the triangles of a previously declared mesh
+		int sourceId = GetInt(xmlNode, "instanceOf");
+		auto it = sceneObjects.find(sourceId);
+		std::shared_ptr<Mesh> sourceMesh;
+		if (it != sceneObjects.end())
+		{
+			sourceMesh = std::dynamic_pointer_cast<Mesh>(it->second);
+		}
+		if (sourceMesh == nullptr)
+		{
+			throw std::runtime_error("mesh " + std::to_string(id) + " is an instance of an unknown mesh (" + std::to_string(sourceId) + ")");
+		}
+		geometry = sourceMesh->geometry;
+	}
+	else if (HasValue(xmlNode, "obj"))
+	{
+		std::string objFileName = GetValue(xmlNode, "obj");
+		auto it = meshGeometries.find(objFileName);
+		if (it == meshGeometries.end())
+		{
+			geometry = ModelLoader::LoadObj(objFileName);
+			meshGeometries[objFileName] = geometry;
+			newGeometry = true;
+		}
+		else
+		{
+			geometry = it->second;
+		}
 	}
 	else
 	{
@@ -184,13 +306,26 @@ void SceneLoader::ParseMesh(std::unique_ptr<Scene>& scene, std::map<int, std::sh
 		assert(normalsFileName != "");
 		assert(uvsFileName != "");
 		assert(indicesFileName != "");
-		mesh = std::unique_ptr<Mesh>(new Mesh());
-		ReadFileToVector(verticesFileName, mesh->vertices);
-		ReadFileToVector(normalsFileName, mesh->normals);
-		ReadFileToVector(uvsFileName, mesh->uvs);
-		ReadFileToVector(indicesFileName, mesh->indices);
+		std::string key = verticesFileName + "|" + normalsFileName + "|" + uvsFileName + "|" + indicesFileName;
+		auto it = meshGeometries.find(key);
+		if (it == meshGeometries.end())
+		{
+			geometry = std::shared_ptr<MeshGeometry>(new MeshGeometry());
+			ReadFileToVector(verticesFileName, geometry->vertices);
+			ReadFileToVector(normalsFileName, geometry->normals);
+			ReadFileToVector(uvsFileName, geometry->uvs);
+			ReadFileToVector(indicesFileName, geometry->indices);
+			meshGeometries[key] = geometry;
+			newGeometry = true;
+		}
+		else
+		{
+			geometry = it->second;
+		}
 	}
 
+	std::shared_ptr<Mesh> mesh(new Mesh(geometry));
+
 	for (auto* child = xmlNode->first_node(); child; child = child->next_sibling())
 	{
 		if (strcmp("Transform", child->name()) == 0)
@@ -203,11 +338,17 @@ void SceneLoader::ParseMesh(std::unique_ptr<Scene>& scene, std::map<int, std::sh
 		}
 	}
 
-	// TODO: generalize bounding volume creation
-	std::unique_ptr<BoundingVolume> boundingVolume(new BoundingSphere());
-	boundingVolume->Compute(mesh->vertices);
-	mesh->boundingVolume = std::move(boundingVolume);
-	
+	// hierarchy and bounding volume settings belong to the shared geometry, so only the mesh that loads it can set them
+	if (newGeometry)
+	{
+		ParseBVHSettings(xmlNode, geometry->bvhSettings);
+
+		if (HasValue(xmlNode, "boundingVolume"))
+		{
+			geometry->boundingVolumeType = GetBoundingVolumeType(xmlNode, "boundingVolume");
+		}
+	}
+
 	sceneObjects[id] = mesh;
 }
 
@@ -318,6 +459,94 @@ bool SceneLoader::GetBool(rapidxml::xml_node<>* xmlNode, const std::string& name
 	return (b != 0);
 }
 
+//////////////////////////////////////////////////////////////////////////
+void SceneLoader::ParseBVHSettings(rapidxml::xml_node<>* xmlNode, BVHSettings& rSettings)
+{
+	if (HasValue(xmlNode, "bvhLeafSize"))
+	{
+		rSettings.maxLeafSize = GetInt(xmlNode, "bvhLeafSize");
+	}
+
+	if (HasValue(xmlNode, "bvhBins"))
+	{
+		rSettings.numberOfBins = GetInt(xmlNode, "bvhBins");
+	}
+
+	if (HasValue(xmlNode, "bvhWidth"))
+	{
+		rSettings.width = GetInt(xmlNode, "bvhWidth");
+	}
+
+	if (HasValue(xmlNode, "bvhQuantization"))
+	{
+		rSettings.quantizationBits = GetInt(xmlNode, "bvhQuantization");
+	}
+
+	if (HasValue(xmlNode, "bvhBuilder"))
+	{
+		rSettings.builder = GetBVHBuilder(xmlNode, "bvhBuilder");
+	}
+
+	if (HasValue(xmlNode, "bvhSplitBudget"))
+	{
+		rSettings.spatialSplitBudget = GetFloat(xmlNode, "bvhSplitBudget");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+BVHBuilder SceneLoader::GetBVHBuilder(rapidxml::xml_node<>* xmlNode, const std::string& name)
+{
+	std::string value = GetValue(xmlNode, name);
+	if (value == "auto")
+	{
+		return BB_AUTO;
+	}
+	else if (value == "sah")
+	{
+		return BB_BINNED_SAH;
+	}
+	else if (value == "lbvh")
+	{
+		return BB_LINEAR;
+	}
+	else if (value == "sbvh")
+	{
+		return BB_SPATIAL_SPLITS;
+	}
+	throw std::runtime_error("unknown bvh builder: " + value);
+}
+
+//////////////////////////////////////////////////////////////////////////
+BoundingVolumeType SceneLoader::GetBoundingVolumeType(rapidxml::xml_node<>* xmlNode, const std::string& name)
+{
+	std::string value = GetValue(xmlNode, name);
+	if (value == "none")
+	{
+		return BVT_NONE;
+	}
+	else if (value == "auto")
+	{
+		return BVT_AUTO;
+	}
+	else if (value == "sphere")
+	{
+		return BVT_SPHERE;
+	}
+	else if (value == "aabb")
+	{
+		return BVT_AABB;
+	}
+	else if (value == "obb")
+	{
+		return BVT_OBB;
+	}
+	else if (value == "kdop")
+	{
+		return BVT_KDOP;
+	}
+	throw std::runtime_error("unknown bounding volume: " + value);
+}
+
 //////////////////////////////////////////////////////////////////////////
 ColorRGBA SceneLoader::GetColorRGBA(rapidxml::xml_node<>* xmlNode, const std::string& name)
 {
@@ -382,6 +611,23 @@ void SceneLoader::ReadFileToVector(const std::string& fileName, std::vector<Vect
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////
+void SceneLoader::ReadFileToVector(const std::string& fileName, std::vector<Vector4F>& v)
+{
+	std::string buffer(FileReader::Read<char>(fileName, FileMode::FM_TEXT, true).get());
+	std::vector<std::string> lines;
+	StringUtils::Tokenize(buffer, "\n", lines);
+	float x, y, z, w;
+	for (unsigned int i = 0; i < lines.size(); i++)
+	{
+		std::string& rLine = lines[i];
+		if (sscanf(rLine.c_str(), "%f, %f, %f, %f", &x, &y, &z, &w) == 4)
+		{
+			v.push_back(Vector4F(x, y, z, w));
+		}
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 void SceneLoader::ReadFileToVector(const std::string& fileName, std::vector<Vector2F>& v)
 {
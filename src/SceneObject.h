@@ -5,8 +5,11 @@
 #include <vector>
 #include <memory>
 
+#include "AABB.h"
 #include "Ray.h"
 #include "RayHit.h"
+#include "RayPacket.h"
+#include "HitAttributes.h"
 #include "Transform.h"
 #include "Material.h"
 #include "Vector3F.h"
@@ -30,11 +33,62 @@ struct SceneObject
 		return mWorldTransform.ToMatrix4x4F();
 	}
 
-	virtual bool Intersect(const Ray& rRay, RayHit& rHit) const
+	// closest-hit query over (rRay.tMin, rRay.tMax]: only fills the compact hit record and shrinks rRay.tMax to the hit.
+	// ignoredPrimitive (Ray::NO_ORIGIN for none) is never hit, it's the primitive the ray starts on
+	virtual bool Intersect(const Ray& rRay, RayHit& rHit, unsigned int /*ignoredPrimitive*/) const
 	{
 		return false;
 	}
 
+	// closest-hit query for the rays of rayMask in a packet, each one in (0, rPacket.tMax]. fills pHits for the rays
+	// hit and returns their mask. objects without a packet query of their own test the rays one by one
+	virtual unsigned long long IntersectPacket(const RayPacket& rPacket, unsigned long long rayMask, RayHit* pHits) const
+	{
+		unsigned long long hits = 0;
+		for (; rayMask != 0; rayMask &= rayMask - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rayMask);
+			if (Intersect(rPacket.GetRay(i), pHits[i], Ray::NO_ORIGIN))
+			{
+				hits |= RayPacket::Bit(i);
+			}
+		}
+		return hits;
+	}
+
+	// surface attributes of a hit previously returned by Intersect
+	virtual void EvaluateAttributes(const Ray& rRay, const RayHit& rHit, HitAttributes& rAttributes) const
+	{
+		rAttributes.point = rRay.origin + rHit.t * rRay.direction;
+	}
+
+	// any-hit query: true if the ray hits the object in (rRay.tMin, rRay.tMax), rPrimitive receives the primitive hit.
+	// hit attributes are never computed, so primitives should override the fallback below with an early-out version
+	virtual bool Occluded(const Ray& rRay, unsigned int ignoredPrimitive, unsigned int& rPrimitive) const
+	{
+		Ray ray = rRay;
+		RayHit hit;
+		if (!Intersect(ray, hit, ignoredPrimitive) || hit.t >= rRay.tMax)
+		{
+			return false;
+		}
+		rPrimitive = hit.primitive;
+		return true;
+	}
+
+	// any-hit query against a single primitive, as reported by Occluded. objects made of many primitives should override
+	// the fallback below, which tests the whole object
+	virtual bool PrimitiveOccluded(const Ray& rRay, unsigned int /*primitive*/) const
+	{
+		unsigned int occluder;
+		return Occluded(rRay, Ray::NO_ORIGIN, occluder);
+	}
+
+	virtual AABB GetWorldBounds() const
+	{
+		return AABB();
+	}
+
 	virtual void Update()
 	{
 		mWorldTransform = localTransform;
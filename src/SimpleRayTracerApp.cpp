@@ -6,6 +6,7 @@
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <set>
 
 #include "Common.h"
 #include "SimpleRayTracerApp.h"
@@ -13,10 +14,12 @@
 #include "ColorRGBA.h"
 #include "Sphere.h"
 #include "Mesh.h"
+#include "SphereSet.h"
 #include "PointLight.h"
 #include "TextureLoader.h"
 #include "SceneLoader.h"
 #include "StringUtils.h"
+#include "BVH.h"
 
 #define Win32Assert(resultHandle, errorMessage) \
 	if ((resultHandle) == 0) \
@@ -49,6 +52,8 @@ const float SimpleRayTracerApp::ANGLE_INCREMENT = 0.05f;
 const float SimpleRayTracerApp::CAMERA_PITCH_LIMIT = 1.0472f; // 60 deg.
 const float SimpleRayTracerApp::CAMERA_MOVE_SPEED = 10.0f;
 const float SimpleRayTracerApp::DEBUG_RAY_MOVE_SPEED = 1000.0f;
+const unsigned int SimpleRayTracerApp::BENCHMARK_MODE = 1;
+const unsigned int SimpleRayTracerApp::SELF_TEST_MODE = 2;
 
 //////////////////////////////////////////////////////////////////////////
 SimpleRayTracerApp::SimpleRayTracerApp() :
@@ -63,6 +68,7 @@ SimpleRayTracerApp::SimpleRayTracerApp() :
 	mOpenGLRenderer(0),
 	mRenderer(0),
 	mLoadScene(true),
+	mBenchmark(false),
 	mRightMouseButtonPressed(false),
 	mLastMousePosition(-1, -1),
 	mCameraPhi(0),
@@ -122,6 +128,17 @@ int SimpleRayTracerApp::Run()
 		exit(EXIT_FAILURE);
 	}
 
+	mpSceneFileName = tokens[1];
+
+	// the fifth argument, if any, selects a mode: BENCHMARK_MODE turns on benchmark reports (e.g., builder comparisons)
+	// when a scene loads, SELF_TEST_MODE runs the self-tests on the scene and exits without opening a window
+	unsigned int mode = (tokens.size() >= 6) ? atoi(tokens[5].c_str()) : 0;
+	if (mode == SELF_TEST_MODE)
+	{
+		return RunSelfTests();
+	}
+	mBenchmark = (mode == BENCHMARK_MODE);
+
 	mApplicationHandle = GetModuleHandle(0);
 
 	Win32Assert(RegisterClassEx(&CreateWindowClass()), "RegisterClassEx failed");
@@ -135,8 +152,6 @@ int SimpleRayTracerApp::Run()
 	SetForegroundWindow(mWindowHandle);
 	SetFocus(mWindowHandle);
 
-	mpSceneFileName = tokens[1];
-
 	bool onlyOneFrame = false;
 	if (tokens.size() >= 3)
 	{
@@ -144,6 +159,18 @@ int SimpleRayTracerApp::Run()
 	}
 
 	mRayTracer = std::shared_ptr<RayTracer>(new RayTracer());
+
+	// the third argument, if any, is the number of threads tracing the frame (0 uses every hardware thread)
+	if (tokens.size() >= 4)
+	{
+		mRayTracer->SetNumberOfThreads(atoi(tokens[3].c_str()));
+	}
+
+	// the fourth argument, if any, is the side of the tiles the frame is split into (0 keeps the default)
+	if (tokens.size() >= 5 && atoi(tokens[4].c_str()) > 0)
+	{
+		mRayTracer->SetTileSize(atoi(tokens[4].c_str()));
+	}
 	mOpenGLRenderer = std::shared_ptr<OpenGLRenderer>(new OpenGLRenderer());
 
 	mRayTracer->Start();
@@ -171,6 +198,8 @@ int SimpleRayTracerApp::Run()
 		try
 		{
 			auto start = std::chrono::system_clock::now().time_since_epoch();
+			BVH::ResetStatistics();
+			RayTracer::ResetShadowCacheStatistics();
 			if (mLoadScene)
 			{
 				LoadSceneFromXML();
@@ -186,6 +215,15 @@ int SimpleRayTracerApp::Run()
 			memset(mPressedKeys, 0, sizeof(mPressedKeys));
 			std::stringstream stream;
 			stream << std::fixed << std::setprecision(5) << WINDOW_TITLE << " @ fps: " << (1 / deltaTime);
+			if (IsRayTracingEnabled())
+			{
+				const BVHStatistics& rStatistics = BVH::GetStatistics();
+				stream << " @ bvh node visits: " << rStatistics.nodeVisits << ", primitive tests: " << rStatistics.primitiveTests;
+				const ShadowCacheStatistics& rShadowCacheStatistics = RayTracer::GetShadowCacheStatistics();
+				stream << " @ shadow cache hits: " << rShadowCacheStatistics.hits << "/" << rShadowCacheStatistics.lookups;
+				const TileSchedulerStatistics& rTileStatistics = mRayTracer->GetTileStatistics();
+				stream << " @ tile steals: " << rTileStatistics.steals << ", load imbalance: " << (rTileStatistics.LoadImbalance() * 100) << "%";
+			}
 			SetWindowText(mWindowHandle, stream.str().c_str());
 			SwapBuffers(mDeviceContextHandle);
 
@@ -262,6 +300,11 @@ void SimpleRayTracerApp::LoadSceneFromXML()
 		exit(EXIT_FAILURE);
 	}
 	mScene->Update();
+	PrintBVHMemory();
+	if (mBenchmark)
+	{
+		PrintSpatialSplitComparison();
+	}
 
 	auto& camera = mScene->GetCamera();
 	auto forward = camera->localTransform.forward();
@@ -270,6 +313,128 @@ void SimpleRayTracerApp::LoadSceneFromXML()
 	UpdateCameraRotation();
 }
 
+//////////////////////////////////////////////////////////////////////////
+void SimpleRayTracerApp::PrintBVHMemory() const
+{
+	// every shared geometry is counted once
+	std::set<const MeshGeometry*> geometries;
+	unsigned int numberOfSphereSets = 0;
+	size_t meshMemory = 0, meshFullPrecisionMemory = 0, sphereSetMemory = 0, sphereSetFullPrecisionMemory = 0;
+	float meshTraversalCost = 0, meshFullPrecisionTraversalCost = 0, sphereSetTraversalCost = 0, sphereSetFullPrecisionTraversalCost = 0;
+	for (unsigned int i = 0; i < mScene->NumberOfSceneObjects(); i++)
+	{
+		auto sceneObject = mScene->GetSceneObject(i).lock();
+		auto sphereSet = std::dynamic_pointer_cast<SphereSet>(sceneObject);
+		if (sphereSet != nullptr)
+		{
+			const BVH& rBVH = sphereSet->GetBVH();
+			sphereSetMemory += rBVH.GetMemory();
+			sphereSetFullPrecisionMemory += rBVH.GetFullPrecisionMemory();
+			sphereSetTraversalCost += rBVH.GetTraversalCost();
+			sphereSetFullPrecisionTraversalCost += rBVH.GetFullPrecisionTraversalCost();
+			numberOfSphereSets++;
+			continue;
+		}
+
+		auto mesh = std::dynamic_pointer_cast<Mesh>(sceneObject);
+		if (mesh == nullptr || !geometries.insert(mesh->geometry.get()).second)
+		{
+			continue;
+		}
+		const BVH& rBVH = mesh->geometry->GetBVH();
+		meshMemory += rBVH.GetMemory();
+		meshFullPrecisionMemory += rBVH.GetFullPrecisionMemory();
+		meshTraversalCost += rBVH.GetTraversalCost();
+		meshFullPrecisionTraversalCost += rBVH.GetFullPrecisionTraversalCost();
+	}
+
+	// formatted apart, so that std::cout keeps its own precision
+	std::stringstream stream;
+	stream << std::fixed << std::setprecision(1);
+	if (!geometries.empty())
+	{
+		stream << "Mesh BVHs: " << (meshMemory / 1024.0) << " KB (" << (meshFullPrecisionMemory / 1024.0) << " KB at full precision), "
+			<< "expected traversal cost: " << meshTraversalCost << " (" << meshFullPrecisionTraversalCost << " at full precision)" << std::endl;
+	}
+	if (numberOfSphereSets > 0)
+	{
+		stream << "Sphere set BVHs: " << (sphereSetMemory / 1024.0) << " KB (" << (sphereSetFullPrecisionMemory / 1024.0) << " KB at full precision), "
+			<< "expected traversal cost: " << sphereSetTraversalCost << " (" << sphereSetFullPrecisionTraversalCost << " at full precision)" << std::endl;
+	}
+	stream << "Scene accelerator: " << (mScene->GetAccelerator()->GetMemory() / 1024.0) << " KB" << std::endl;
+	std::cout << stream.str();
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SimpleRayTracerApp::PrintSpatialSplitComparison() const
+{
+	// every spatial split BVH is compared against the same hierarchy built with object splits only, which takes a second build
+	std::set<const MeshGeometry*> geometries;
+	for (unsigned int i = 0; i < mScene->NumberOfSceneObjects(); i++)
+	{
+		auto mesh = std::dynamic_pointer_cast<Mesh>(mScene->GetSceneObject(i).lock());
+		if (mesh == nullptr || !geometries.insert(mesh->geometry.get()).second)
+		{
+			continue;
+		}
+
+		const BVH& rBVH = mesh->geometry->GetBVH();
+		if (rBVH.GetBuilder() != BB_SPATIAL_SPLITS)
+		{
+			continue;
+		}
+
+		std::vector<AABB> triangleBounds;
+		mesh->geometry->ComputeTriangleBounds(triangleBounds);
+		BVHSettings settings = mesh->geometry->bvhSettings;
+		settings.builder = BB_BINNED_SAH;
+		BVH objectSplitBVH;
+		objectSplitBVH.Build(triangleBounds, settings);
+		std::stringstream stream;
+		stream << std::fixed << std::setprecision(1) << "Spatial split BVH: " << rBVH.NumberOfReferences() << " references to " << rBVH.NumberOfPrimitives() << " triangles, "
+			<< "SAH cost: " << rBVH.GetBuildSAHCost() << " (" << objectSplitBVH.GetBuildSAHCost() << " with object splits only), "
+			<< "expected traversal cost: " << rBVH.GetTraversalCost() << " (" << objectSplitBVH.GetTraversalCost() << ")" << std::endl;
+		std::cout << stream.str();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+unsigned int SimpleRayTracerApp::CountTriangleKernelMismatches() const
+{
+	// the 8-wide kernel must agree to the bit with the scalar one, or meshes would render differently depending on the build
+	std::set<const MeshGeometry*> geometries;
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < mScene->NumberOfSceneObjects(); i++)
+	{
+		auto mesh = std::dynamic_pointer_cast<Mesh>(mScene->GetSceneObject(i).lock());
+		if (mesh == nullptr || !geometries.insert(mesh->geometry.get()).second)
+		{
+			continue;
+		}
+		mismatches += mesh->geometry->GetTriangleBuffer().CountIntersect8Mismatches();
+	}
+	return mismatches;
+}
+
+//////////////////////////////////////////////////////////////////////////
+int SimpleRayTracerApp::RunSelfTests()
+{
+	try
+	{
+		mScene = SceneLoader::LoadFromXML(mpSceneFileName);
+	}
+	catch (std::runtime_error& rException)
+	{
+		std::cout << rException.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	mScene->Update();
+
+	unsigned int mismatches = CountTriangleKernelMismatches();
+	std::cout << "Triangle kernels: " << mismatches << " mismatches between the 8-wide and the scalar kernel" << std::endl;
+	return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 //////////////////////////////////////////////////////////////////////////
 void SimpleRayTracerApp::MoveCameraLeft(float deltaTime)
 {
@@ -378,6 +543,14 @@ void SimpleRayTracerApp::ProcessKeys(float deltaTime)
 	{
 		mLoadScene = true;
 	}
+	else if (mPressedKeys[VK_F6])
+	{
+		ToggleWavefront();
+	}
+	else if (mPressedKeys[VK_F7])
+	{
+		CyclePacketSize();
+	}
 	if (mKeys[VK_NUMPAD4])
 	{
 		MoveDebugRayLeft(deltaTime);
@@ -473,6 +646,23 @@ void SimpleRayTracerApp::ToggleRayTraceDebug()
 	mRayTracer->SetDebug(rayTracerDebug);
 }
 
+//////////////////////////////////////////////////////////////////////////
+void SimpleRayTracerApp::ToggleWavefront()
+{
+	bool wavefront = !mRayTracer->WavefrontEnabled();
+	std::cout << "Wavefront: " << srt_boolStr(wavefront) << std::endl;
+	mRayTracer->SetWavefront(wavefront);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SimpleRayTracerApp::CyclePacketSize()
+{
+	// 8x8, 4x4, 2x2 and single ray packets, in that order
+	unsigned int packetSize = (mRayTracer->GetPacketSize() == 1) ? 8 : mRayTracer->GetPacketSize() / 2;
+	std::cout << "Packet size: " << packetSize << "x" << packetSize << std::endl;
+	mRayTracer->SetPacketSize(packetSize);
+}
+
 //////////////////////////////////////////////////////////////////////////
 void SimpleRayTracerApp::KeyDown(unsigned int virtualKey)
 {
@@ -55,6 +55,8 @@ private:
 	static const float CAMERA_PITCH_LIMIT;
 	static const float CAMERA_MOVE_SPEED;
 	static const float DEBUG_RAY_MOVE_SPEED;
+	static const unsigned int BENCHMARK_MODE;
+	static const unsigned int SELF_TEST_MODE;
 
 	static SimpleRayTracerApp* s_mpInstance;
 
@@ -70,6 +72,7 @@ private:
 	std::shared_ptr<OpenGLRenderer> mOpenGLRenderer;
 	std::shared_ptr<Renderer> mRenderer;
 	bool mLoadScene;
+	bool mBenchmark;
 	bool mRightMouseButtonPressed;
 	bool mKeys[0xFF];
 	bool mPressedKeys[0xFF];
@@ -79,6 +82,10 @@ private:
 	Vector2F mDebugRayCoords;
 
 	void LoadSceneFromXML();
+	void PrintBVHMemory() const;
+	void PrintSpatialSplitComparison() const;
+	unsigned int CountTriangleKernelMismatches() const;
+	int RunSelfTests();
 	void Dispose();
 	WNDCLASSEX CreateWindowClass();
 	void KeyDown(unsigned int virtualKey);
@@ -106,6 +113,8 @@ private:
 	void UpdateDebugRay();
 	void ToggleCollectRayMetadata();
 	void ToggleRayTraceDebug();
+	void ToggleWavefront();
+	void CyclePacketSize();
 
 };
 
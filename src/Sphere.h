@@ -17,11 +17,53 @@ struct Sphere : public SceneObject
 	{
 	}
 
-	virtual bool Intersect(const Ray& rRay, RayHit& rHit) const
+	// a sphere is a single primitive, so rays starting on it never hit it
+	virtual bool Intersect(const Ray& rRay, RayHit& rHit, unsigned int ignoredPrimitive) const
+	{
+		float t;
+		if (ignoredPrimitive == 0 || !IntersectSurface(rRay, t) || t > rRay.tMax)
+		{
+			return false;
+		}
+
+		rRay.tMax = t;
+		rHit.t = t;
+
+		return true;
+	}
+
+	virtual void EvaluateAttributes(const Ray& rRay, const RayHit& rHit, HitAttributes& rAttributes) const
+	{
+		rAttributes.point = rRay.origin + (rHit.t * rRay.direction);
+		rAttributes.normal = (rAttributes.point - mWorldTransform.position).Normalized();
+
+		if (material.texture != nullptr)
+		{
+			// Spherical Mapping with Normals:
+			// http://www.mvps.org/directx/articles/spheremap.htm
+			rAttributes.uv = Vector2F(asin(rAttributes.normal.x()) / srt_PI + 0.5f, asin(rAttributes.normal.y()) / srt_PI + 0.5f);
+		}
+	}
+
+	virtual bool Occluded(const Ray& rRay, unsigned int ignoredPrimitive, unsigned int& rPrimitive) const
+	{
+		rPrimitive = 0;
+		float t;
+		return ignoredPrimitive != 0 && IntersectSurface(rRay, t) && t < rRay.tMax;
+	}
+
+	virtual AABB GetWorldBounds() const
+	{
+		return AABB(mWorldTransform.position - radius, mWorldTransform.position + radius);
+	}
+
+private:
+	// nearest root of the ray/sphere quadratic past rRay.tMin (the far one for rays that start inside or past the near one)
+	bool IntersectSurface(const Ray& rRay, float& t) const
 	{
 		Vector3F viewerDirection = rRay.origin - mWorldTransform.position;
 
-		float a = rRay.direction.Dot(rRay.direction);
+		float a = rRay.directionDot;
 		float b = 2.0f * rRay.direction.Dot(viewerDirection);
 		float c = viewerDirection.Dot(viewerDirection) - (radius * radius);
 
@@ -38,21 +80,15 @@ struct Sphere : public SceneObject
 		float t1 = (-b - sqrtDelta) / a2;
 		float t2 = (-b + sqrtDelta) / a2;
 
-		float t = (t1 < t2) ? t1 : t2;
-
-		if (t <= 0)
+		if (t1 > t2)
 		{
-			return false;
+			float tmp = t1;
+			t1 = t2;
+			t2 = tmp;
 		}
+		t = (t1 > rRay.tMin) ? t1 : t2;
 
-		rHit.point = rRay.origin + (t * rRay.direction);
-		rHit.normal = (rHit.point - mWorldTransform.position).Normalized();
-
-		// Spherical Mapping with Normals:
-		// http://www.mvps.org/directx/articles/spheremap.htm
-		rHit.uv = Vector2F(asin(rHit.normal.x()) / srt_PI + 0.5f, asin(rHit.normal.y()) / srt_PI + 0.5f);
-
-		return true;
+		return t > rRay.tMin;
 	}
 
 };
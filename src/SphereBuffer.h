@@ -0,0 +1,152 @@
+#ifndef SPHEREBUFFER_H_
+#define SPHEREBUFFER_H_
+
+#include <vector>
+#include <cmath>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "Ray.h"
+#include "Vector3F.h"
+
+// sphere centers and squared radii in structure of arrays form.
+// slots follow the order of a BVH leaves, so a leaf is a contiguous range of every array
+struct SphereBuffer
+{
+	std::vector<float> centerx, centery, centerz;
+	std::vector<float> radiusSquared;
+	// original sphere of each slot
+	std::vector<unsigned int> spheres;
+	// slot of each original sphere (any of them for spheres that several leaves reference)
+	std::vector<unsigned int> slots;
+
+	// number of spheres tested at once by Intersect8
+	static const unsigned int LANES = 8;
+
+	SphereBuffer() = default;
+	~SphereBuffer() = default;
+
+	inline unsigned int Size() const
+	{
+		return static_cast<unsigned int>(spheres.size());
+	}
+
+	void Build(const std::vector<Vector3F>& rCenters, const std::vector<float>& rRadii, const std::vector<unsigned int>& rOrder)
+	{
+		unsigned int size = static_cast<unsigned int>(rOrder.size());
+		centerx.resize(size); centery.resize(size); centerz.resize(size);
+		radiusSquared.resize(size);
+		spheres.resize(size);
+		slots.assign(rCenters.size(), 0);
+
+		for (unsigned int slot = 0; slot < size; slot++)
+		{
+			unsigned int sphere = rOrder[slot];
+			centerx[slot] = rCenters[sphere].x(); centery[slot] = rCenters[sphere].y(); centerz[slot] = rCenters[sphere].z();
+			radiusSquared[slot] = rRadii[sphere] * rRadii[sphere];
+			spheres[slot] = sphere;
+			slots[sphere] = slot;
+		}
+
+		// padding lets Intersect8 load full lanes past the last sphere, the lanes are masked out anyway
+		unsigned int paddedSize = size + LANES - 1;
+		centerx.resize(paddedSize, 0); centery.resize(paddedSize, 0); centerz.resize(paddedSize, 0);
+		radiusSquared.resize(paddedSize, 0);
+	}
+
+	// tests the ray against the slots [first, first + count), count <= LANES, with the same semantics as SphereIntersection.
+	// returns a bit mask of the slots that were hit, their ray parameters are written to pT
+	inline unsigned int Intersect8(const Ray& rRay, unsigned int first, unsigned int count, float* pT) const
+	{
+		float directionDot = rRay.directionDot;
+		float inverseDirectionDot = 1.0f / directionDot;
+#ifdef __AVX__
+		// every operation is done in the same order as in the scalar version so that both agree to the bit
+		__m256 dx = _mm256_set1_ps(rRay.direction.x()), dy = _mm256_set1_ps(rRay.direction.y()), dz = _mm256_set1_ps(rRay.direction.z());
+
+		// f = origin - center
+		__m256 fx = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.x()), _mm256_loadu_ps(&centerx[first]));
+		__m256 fy = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.y()), _mm256_loadu_ps(&centery[first]));
+		__m256 fz = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.z()), _mm256_loadu_ps(&centerz[first]));
+		__m256 r2 = _mm256_loadu_ps(&radiusSquared[first]);
+
+		__m256 b = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, dx), _mm256_mul_ps(fy, dy)), _mm256_mul_ps(fz, dz)));
+
+		// f minus its projection on the direction: distance of the center to the ray line
+		__m256 k = _mm256_mul_ps(b, _mm256_set1_ps(inverseDirectionDot));
+		__m256 px = _mm256_add_ps(fx, _mm256_mul_ps(k, dx));
+		__m256 py = _mm256_add_ps(fy, _mm256_mul_ps(k, dy));
+		__m256 pz = _mm256_add_ps(fz, _mm256_mul_ps(k, dz));
+		__m256 delta = _mm256_sub_ps(r2, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(pz, pz)));
+
+		unsigned int mask = static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(delta, _mm256_setzero_ps(), _CMP_GE_OQ))) & ((1u << count) - 1);
+		if (mask == 0)
+		{
+			return 0;
+		}
+
+		__m256 root = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(directionDot), delta));
+		__m256 signMask = _mm256_set1_ps(-0.0f);
+		__m256 q = _mm256_add_ps(b, _mm256_or_ps(_mm256_and_ps(b, signMask), _mm256_andnot_ps(signMask, root)));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)), _mm256_mul_ps(fz, fz)), r2);
+		__m256 t0 = _mm256_div_ps(c, q);
+		__m256 t1 = _mm256_mul_ps(q, _mm256_set1_ps(inverseDirectionDot));
+		__m256 tNear = _mm256_min_ps(t0, t1);
+		__m256 tFar = _mm256_max_ps(t0, t1);
+		__m256 tMin = _mm256_set1_ps(rRay.tMin);
+		__m256 t = _mm256_blendv_ps(tFar, tNear, _mm256_cmp_ps(tNear, tMin, _CMP_GT_OQ));
+		_mm256_storeu_ps(pT, t);
+
+		return mask & static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ)));
+#else
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (SphereIntersection(rRay, directionDot, inverseDirectionDot, first + i, pT[i]))
+			{
+				mask |= (1u << i);
+			}
+		}
+		return mask;
+#endif
+	}
+
+	// nearest root past rRay.tMin (the far one for rays starting inside), from the reduced quadratic
+	// t^2 (d.d) - 2bt + c = 0 with b = -(f.d). the discriminant is taken from the distance of the center to the ray line
+	// and the roots as c/q and q/(d.d), which avoids the cancellation of the textbook formula
+	inline bool SphereIntersection(const Ray& rRay, float directionDot, float inverseDirectionDot, unsigned int slot, float& t) const
+	{
+		float fx = rRay.origin.x() - centerx[slot];
+		float fy = rRay.origin.y() - centery[slot];
+		float fz = rRay.origin.z() - centerz[slot];
+		float r2 = radiusSquared[slot];
+
+		float b = 0.0f - ((fx * rRay.direction.x() + fy * rRay.direction.y()) + fz * rRay.direction.z());
+
+		float k = b * inverseDirectionDot;
+		float px = fx + k * rRay.direction.x();
+		float py = fy + k * rRay.direction.y();
+		float pz = fz + k * rRay.direction.z();
+		float delta = r2 - ((px * px + py * py) + pz * pz);
+
+		if (!(delta >= 0))
+		{
+			return false;
+		}
+
+		float root = sqrt(directionDot * delta);
+		float q = b + copysign(root, b);
+		float c = ((fx * fx + fy * fy) + fz * fz) - r2;
+		float t0 = c / q;
+		float t1 = q * inverseDirectionDot;
+		float tNear = (t0 < t1) ? t0 : t1;
+		float tFar = (t0 > t1) ? t0 : t1;
+		t = (tNear > rRay.tMin) ? tNear : tFar;
+
+		return t > rRay.tMin;
+	}
+
+};
+
+#endif
\ No newline at end of file
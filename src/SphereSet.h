@@ -0,0 +1,261 @@
+#ifndef SPHERESET_H_
+#define SPHERESET_H_
+
+#include <vector>
+#include <climits>
+#include <cfloat>
+
+#include "Common.h"
+#include "SceneObject.h"
+#include "BVH.h"
+#include "SphereBuffer.h"
+
+// many spheres sharing a material (e.g., particles), laid out in structure of arrays form under their own BVH
+// and intersected 8 at a time. spheres are given in object space, so the whole set follows its transform
+struct SphereSet : public SceneObject
+{
+private:
+	Matrix3F cachedInverseModel;
+	Matrix3F cachedNormalMatrix;
+	AABB cachedBounds;
+	BVH cachedBVH;
+	SphereBuffer cachedSpheres;
+	bool cacheValid;
+
+public:
+	std::vector<Vector3F> centers;
+	std::vector<float> radii;
+	BVHSettings bvhSettings;
+
+	SphereSet() :
+		cacheValid(false)
+	{
+	}
+
+	virtual ~SphereSet() = default;
+
+	inline unsigned int NumberOfSpheres() const
+	{
+		return static_cast<unsigned int>(centers.size());
+	}
+
+	inline const BVH& GetBVH() const
+	{
+		return cachedBVH;
+	}
+
+	virtual void Update()
+	{
+		SceneObject::Update();
+
+		if (!cacheValid)
+		{
+			CreateCache();
+		}
+
+		Matrix3F model = mWorldTransform.rotation * mWorldTransform.scale;
+		cachedInverseModel = model.Inverse();
+		cachedNormalMatrix = cachedInverseModel.Transpose();
+
+		// world bounds of the object space box
+		cachedBounds = AABB();
+		if (!cachedBVH.IsEmpty())
+		{
+			const AABB& rBounds = cachedBVH.GetBounds();
+			for (unsigned int i = 0; i < 8; i++)
+			{
+				Vector3F corner((i & 1) ? rBounds.maximum.x() : rBounds.minimum.x(), (i & 2) ? rBounds.maximum.y() : rBounds.minimum.y(), (i & 4) ? rBounds.maximum.z() : rBounds.minimum.z());
+				cachedBounds.Expand(mWorldTransform * corner);
+			}
+		}
+	}
+
+	void CreateCache()
+	{
+		std::vector<AABB> sphereBounds(centers.size());
+		for (unsigned int i = 0; i < centers.size(); i++)
+		{
+			sphereBounds[i] = AABB(centers[i] - radii[i], centers[i] + radii[i]);
+		}
+
+		cachedBVH.Build(sphereBounds, bvhSettings);
+
+		// the spheres are laid out in leaf order so that intersecting a leaf streams through memory
+		cachedSpheres.Build(centers, radii, cachedBVH.GetPrimitiveIndices());
+
+		cacheValid = true;
+	}
+
+	virtual AABB GetWorldBounds() const
+	{
+		return cachedBounds;
+	}
+
+	virtual bool Intersect(const Ray& rRay, RayHit& rHit, unsigned int ignoredPrimitive) const
+	{
+		Ray ray = ToObjectSpace(rRay);
+		unsigned int closestSphere = UINT_MAX;
+		cachedBVH.TraverseLeaves(ray, [&](unsigned int first, unsigned int count)
+		{
+			bool hit = false;
+			for (unsigned int block = first; block < first + count; block += SphereBuffer::LANES)
+			{
+				float ts[SphereBuffer::LANES];
+				unsigned int mask = cachedSpheres.Intersect8(ray, block, srt_min(first + count - block, SphereBuffer::LANES), ts);
+				for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					float newT = ts[lane];
+					if ((mask & 1) == 0 || newT > ray.tMax)
+					{
+						continue;
+					}
+
+					// ties go to the first sphere, as they would in a linear scan
+					unsigned int sphere = cachedSpheres.spheres[block + lane];
+					if (sphere == ignoredPrimitive || (newT == ray.tMax && sphere > closestSphere))
+					{
+						continue;
+					}
+
+					ray.tMax = newT;
+					closestSphere = sphere;
+					hit = true;
+				}
+			}
+			return hit;
+		});
+
+		if (closestSphere == UINT_MAX)
+		{
+			return false;
+		}
+
+		rRay.tMax = ray.tMax;
+		rHit.t = ray.tMax;
+		rHit.primitive = closestSphere;
+		rHit.u = rHit.v = 0;
+
+		return true;
+	}
+
+	virtual unsigned long long IntersectPacket(const RayPacket& rPacket, unsigned long long rayMask, RayHit* pHits) const
+	{
+		// only the rays in the mask are brought into object space, the others are never read
+		RayPacket objectSpacePacket;
+		objectSpacePacket.size = rPacket.size;
+		unsigned int closestSpheres[RayPacket::MAX_SIZE];
+		for (unsigned long long rays = rayMask; rays != 0; rays &= rays - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rays);
+			objectSpacePacket.SetRay(i, ToObjectSpace(rPacket.GetRay(i)));
+			closestSpheres[i] = UINT_MAX;
+		}
+
+		cachedBVH.TraversePacket(objectSpacePacket, rayMask, [&](unsigned int first, unsigned int count, unsigned long long leafRayMask)
+		{
+			unsigned long long hits = 0;
+			for (; leafRayMask != 0; leafRayMask &= leafRayMask - 1)
+			{
+				unsigned int i = RayPacket::FirstRay(leafRayMask);
+				Ray ray = objectSpacePacket.GetRay(i);
+				for (unsigned int block = first; block < first + count; block += SphereBuffer::LANES)
+				{
+					float ts[SphereBuffer::LANES];
+					unsigned int mask = cachedSpheres.Intersect8(ray, block, srt_min(first + count - block, SphereBuffer::LANES), ts);
+					for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+					{
+						float newT = ts[lane];
+						if ((mask & 1) == 0 || newT > objectSpacePacket.tMax[i])
+						{
+							continue;
+						}
+
+						unsigned int sphere = cachedSpheres.spheres[block + lane];
+						if (newT == objectSpacePacket.tMax[i] && sphere > closestSpheres[i])
+						{
+							continue;
+						}
+
+						objectSpacePacket.tMax[i] = newT;
+						closestSpheres[i] = sphere;
+						pHits[i].t = newT;
+						pHits[i].primitive = sphere;
+						pHits[i].u = pHits[i].v = 0;
+						hits |= RayPacket::Bit(i);
+					}
+				}
+			}
+			return hits;
+		});
+
+		unsigned long long hits = 0;
+		for (unsigned long long rays = rayMask; rays != 0; rays &= rays - 1)
+		{
+			unsigned int i = RayPacket::FirstRay(rays);
+			if (closestSpheres[i] != UINT_MAX)
+			{
+				hits |= RayPacket::Bit(i);
+			}
+		}
+		return hits;
+	}
+
+	virtual void EvaluateAttributes(const Ray& rRay, const RayHit& rHit, HitAttributes& rAttributes) const
+	{
+		rAttributes.point = rRay.origin + (rHit.t * rRay.direction);
+
+		// the object space normal is brought to world space with the inverse transpose, which also handles non-uniform scales
+		Vector3F objectSpacePoint = cachedInverseModel * (rAttributes.point - mWorldTransform.position);
+		rAttributes.normal = (cachedNormalMatrix * (objectSpacePoint - centers[rHit.primitive])).Normalized();
+
+		if (material.texture != nullptr)
+		{
+			// same spherical mapping as Sphere
+			rAttributes.uv = Vector2F(asin(rAttributes.normal.x()) / srt_PI + 0.5f, asin(rAttributes.normal.y()) / srt_PI + 0.5f);
+		}
+	}
+
+	virtual bool Occluded(const Ray& rRay, unsigned int ignoredPrimitive, unsigned int& rPrimitive) const
+	{
+		Ray ray = ToObjectSpace(rRay);
+		return cachedBVH.TraverseLeaves(ray, [&](unsigned int first, unsigned int count)
+		{
+			for (unsigned int block = first; block < first + count; block += SphereBuffer::LANES)
+			{
+				float ts[SphereBuffer::LANES];
+				unsigned int mask = cachedSpheres.Intersect8(ray, block, srt_min(first + count - block, SphereBuffer::LANES), ts);
+				for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if ((mask & 1) != 0 && ts[lane] < ray.tMax && cachedSpheres.spheres[block + lane] != ignoredPrimitive)
+					{
+						rPrimitive = cachedSpheres.spheres[block + lane];
+						return true;
+					}
+				}
+			}
+			return false;
+		}, true);
+	}
+
+	virtual bool PrimitiveOccluded(const Ray& rRay, unsigned int primitive) const
+	{
+		if (primitive >= cachedSpheres.slots.size())
+		{
+			return false;
+		}
+
+		Ray ray = ToObjectSpace(rRay);
+		float t;
+		return cachedSpheres.Intersect8(ray, cachedSpheres.slots[primitive], 1, &t) != 0 && t < ray.tMax;
+	}
+
+private:
+	// the transform is affine, so the ray parameter of a hit (and so the ray interval) is the same in both spaces
+	inline Ray ToObjectSpace(const Ray& rRay) const
+	{
+		return Ray(cachedInverseModel * (rRay.origin - mWorldTransform.position), cachedInverseModel * rRay.direction, rRay.tMin, rRay.tMax);
+	}
+
+};
+
+#endif
\ No newline at end of file
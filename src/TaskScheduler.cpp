@@ -0,0 +1,164 @@
+#include "TaskScheduler.h"
+
+//////////////////////////////////////////////////////////////////////////
+TaskScheduler::TaskScheduler(unsigned int numberOfThreads) :
+	mShutdown(false)
+{
+	if (numberOfThreads == 0)
+	{
+		numberOfThreads = srt_max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	for (unsigned int i = 1; i < numberOfThreads; i++)
+	{
+		mWorkers.emplace_back(&TaskScheduler::WorkerLoop, this);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	mTaskAvailable.notify_all();
+
+	for (unsigned int i = 0; i < mWorkers.size(); i++)
+	{
+		mWorkers[i].join();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+TaskScheduler& TaskScheduler::GetInstance()
+{
+	static TaskScheduler s_instance;
+	return s_instance;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TaskScheduler::Spawn(TaskGroup& rGroup, Task task)
+{
+	rGroup.mPendingTasks++;
+
+	// without workers the task runs right away
+	if (mWorkers.empty())
+	{
+		QueuedTask queuedTask = { std::move(task), &rGroup };
+		RunTask(queuedTask);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back({ std::move(task), &rGroup });
+	}
+	mTaskAvailable.notify_one();
+	// threads blocked in Wait help with the new task too
+	mTaskDone.notify_all();
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TaskScheduler::Wait(TaskGroup& rGroup)
+{
+	while (!rGroup.IsDone())
+	{
+		if (RunNextTask())
+		{
+			continue;
+		}
+
+		// the queue is empty, so the rest of the group is running on other threads
+		std::unique_lock<std::mutex> lock(mMutex);
+		mTaskDone.wait(lock, [this, &rGroup]()
+		{
+			return rGroup.IsDone() || !mQueue.empty();
+		});
+	}
+
+	if (rGroup.mException != nullptr)
+	{
+		std::exception_ptr exception = rGroup.mException;
+		rGroup.mException = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool TaskScheduler::RunNextTask()
+{
+	QueuedTask queuedTask;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mQueue.empty())
+		{
+			return false;
+		}
+		queuedTask = std::move(mQueue.front());
+		mQueue.pop_front();
+	}
+
+	RunTask(queuedTask);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TaskScheduler::RunTask(QueuedTask& rQueuedTask)
+{
+	// the task is marked done however it ends, or Wait would never return
+	struct Completion
+	{
+		TaskScheduler* pScheduler;
+		TaskGroup* pGroup;
+
+		~Completion()
+		{
+			{
+				// decremented under the lock, so that a thread about to block in Wait cannot miss it
+				std::lock_guard<std::mutex> lock(pScheduler->mMutex);
+				pGroup->mPendingTasks--;
+			}
+			pScheduler->mTaskDone.notify_all();
+		}
+
+	} completion = { this, rQueuedTask.pGroup };
+
+	try
+	{
+		rQueuedTask.task();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (rQueuedTask.pGroup->mException == nullptr)
+		{
+			rQueuedTask.pGroup->mException = std::current_exception();
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TaskScheduler::WorkerLoop()
+{
+	while (true)
+	{
+		QueuedTask queuedTask;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mTaskAvailable.wait(lock, [this]()
+			{
+				return mShutdown || !mQueue.empty();
+			});
+
+			if (mQueue.empty())
+			{
+				return;
+			}
+			queuedTask = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		RunTask(queuedTask);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef TASKSCHEDULER_H_
+#define TASKSCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+#include "Common.h"
+
+// set of tasks that are waited for together (fork-join)
+class TaskGroup
+{
+public:
+	TaskGroup() :
+		mPendingTasks(0)
+	{
+	}
+
+	~TaskGroup() = default;
+
+	inline bool IsDone() const
+	{
+		return mPendingTasks.load() == 0;
+	}
+
+private:
+	friend class TaskScheduler;
+
+	std::atomic<unsigned int> mPendingTasks;
+	// first exception thrown by a task of the group, rethrown by Wait
+	std::exception_ptr mException;
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+};
+
+// pool of persistent worker threads running tasks from a shared queue
+class TaskScheduler
+{
+public:
+	typedef std::function<void()> Task;
+
+	// 0 uses one thread per hardware thread (the thread calling Wait counts as one of them)
+	TaskScheduler(unsigned int numberOfThreads = 0);
+	~TaskScheduler();
+
+	// scheduler shared by everything that runs in parallel (e.g., the BVH builders)
+	static TaskScheduler& GetInstance();
+
+	inline unsigned int NumberOfThreads() const
+	{
+		return static_cast<unsigned int>(mWorkers.size()) + 1;
+	}
+
+	void Spawn(TaskGroup& rGroup, Task task);
+
+	// returns once every task of the group is done. the calling thread runs queued tasks in the meantime,
+	// so tasks can spawn and wait for tasks of their own. if a task threw, its exception is rethrown here
+	void Wait(TaskGroup& rGroup);
+
+	// calls function(first, last) on chunks of [begin, end) of about grainSize elements, in parallel
+	template <typename Function>
+	void ParallelFor(unsigned int begin, unsigned int end, unsigned int grainSize, Function function)
+	{
+		grainSize = srt_max(grainSize, 1u);
+		if (end - begin <= grainSize)
+		{
+			function(begin, end);
+			return;
+		}
+
+		TaskGroup group;
+		for (unsigned int first = begin; first < end; first += grainSize)
+		{
+			unsigned int last = srt_min(first + grainSize, end);
+			Spawn(group, [=, &function]()
+			{
+				function(first, last);
+			});
+		}
+		Wait(group);
+	}
+
+private:
+	struct QueuedTask
+	{
+		Task task;
+		TaskGroup* pGroup;
+
+	};
+
+	std::vector<std::thread> mWorkers;
+	std::deque<QueuedTask> mQueue;
+	std::mutex mMutex;
+	std::condition_variable mTaskAvailable;
+	std::condition_variable mTaskDone;
+	bool mShutdown;
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	bool RunNextTask();
+	void RunTask(QueuedTask& rQueuedTask);
+	void WorkerLoop();
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "TileScheduler.h"
+#include "Common.h"
+
+const unsigned int TileScheduler::MIN_TILE_SIZE = 8;
+const unsigned int TileScheduler::TILES_PER_WORKER = 8;
+
+//////////////////////////////////////////////////////////////////////////
+TileScheduler::TileScheduler() :
+	mWidth(0),
+	mHeight(0),
+	mTileSize(0),
+	mTilesPerRow(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileScheduler::Reset()
+{
+	mWidth = mHeight = mTileSize = mTilesPerRow = 0;
+	mGridTileCosts.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileScheduler::BeginFrame(unsigned int width, unsigned int height, unsigned int tileSize, unsigned int numberOfWorkers)
+{
+	if (width != mWidth || height != mHeight || tileSize != mTileSize)
+	{
+		mWidth = width;
+		mHeight = height;
+		mTileSize = tileSize;
+		mTilesPerRow = (width + tileSize - 1) / tileSize;
+		mGridTileCosts.assign(mTilesPerRow * ((height + tileSize - 1) / tileSize), 0);
+	}
+
+	double frameCost = 0;
+	for (unsigned int i = 0; i < mGridTileCosts.size(); i++)
+	{
+		frameCost += mGridTileCosts[i];
+	}
+
+	// a lone worker has nobody to even out with, so it keeps the grid
+	double maxTileCost = frameCost / (numberOfWorkers * TILES_PER_WORKER);
+	bool split = frameCost > 0 && numberOfWorkers > 1;
+
+	// tiles are kept in grid order (quadrants of a split tile in scanline order), and so is their expected cost
+	mTiles.clear();
+	mStatistics = TileSchedulerStatistics();
+	std::vector<double> tileCosts;
+	for (unsigned int i = 0; i < mGridTileCosts.size(); i++)
+	{
+		unsigned int levels = 0;
+		double cost = mGridTileCosts[i];
+		while (split && cost > maxTileCost && (mTileSize >> (levels + 1)) >= MIN_TILE_SIZE)
+		{
+			cost /= 4;
+			levels++;
+		}
+
+		if (levels > 0)
+		{
+			mStatistics.splitGridTiles++;
+		}
+
+		SplitGridTile(i, levels);
+		// without costs every tile is expected to cost the same
+		tileCosts.resize(mTiles.size(), (frameCost > 0) ? cost : 1);
+	}
+	mTileTimes.assign(mTiles.size(), 0);
+	mStatistics.numberOfTiles = static_cast<unsigned int>(mTiles.size());
+
+	if (mQueues.size() != numberOfWorkers)
+	{
+		mQueues.clear();
+		for (unsigned int i = 0; i < numberOfWorkers; i++)
+		{
+			mQueues.emplace_back(new WorkerQueue());
+		}
+	}
+
+	// each worker is dealt a contiguous run of tiles of about the same expected cost, so it traces neighbouring pixels
+	// until it starts stealing
+	double totalCost = 0;
+	for (unsigned int i = 0; i < tileCosts.size(); i++)
+	{
+		totalCost += tileCosts[i];
+	}
+
+	double dealtCost = 0;
+	for (unsigned int i = 0, worker = 0; i < mTiles.size(); i++)
+	{
+		while (worker + 1 < numberOfWorkers && dealtCost >= totalCost * (worker + 1) / numberOfWorkers)
+		{
+			worker++;
+		}
+		mQueues[worker]->tiles.push_back(i);
+		dealtCost += tileCosts[i];
+	}
+
+	for (unsigned int i = 0; i < numberOfWorkers; i++)
+	{
+		mQueues[i]->steals = 0;
+	}
+	mBusyTimes.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool TileScheduler::NextTile(unsigned int worker, unsigned int& rTile)
+{
+	WorkerQueue& rQueue = *mQueues[worker];
+	{
+		std::lock_guard<std::mutex> lock(rQueue.mutex);
+		if (!rQueue.tiles.empty())
+		{
+			rTile = rQueue.tiles.front();
+			rQueue.tiles.pop_front();
+			return true;
+		}
+	}
+
+	// the back of a deque holds the tiles its owner would trace last
+	for (unsigned int i = 1; i < mQueues.size(); i++)
+	{
+		WorkerQueue& rVictim = *mQueues[(worker + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(rVictim.mutex);
+		if (!rVictim.tiles.empty())
+		{
+			rTile = rVictim.tiles.back();
+			rVictim.tiles.pop_back();
+			rQueue.steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileScheduler::EndTile(unsigned int tile, double seconds)
+{
+	mTileTimes[tile] = seconds;
+
+	std::lock_guard<std::mutex> lock(mBusyTimesMutex);
+	mBusyTimes[std::this_thread::get_id()] += seconds;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileScheduler::EndFrame()
+{
+	for (unsigned int i = 0; i < mGridTileCosts.size(); i++)
+	{
+		mGridTileCosts[i] = 0;
+	}
+	for (unsigned int i = 0; i < mTiles.size(); i++)
+	{
+		mGridTileCosts[mTiles[i].gridTile] += mTileTimes[i];
+	}
+
+	for (unsigned int i = 0; i < mQueues.size(); i++)
+	{
+		mStatistics.steals += mQueues[i]->steals;
+	}
+
+	// the frame was meant to keep one thread per worker busy, the ones that never traced a tile count as idle
+	double totalBusyTime = 0;
+	for (auto& rBusyTime : mBusyTimes)
+	{
+		totalBusyTime += rBusyTime.second;
+		mStatistics.maxBusyTime = srt_max(mStatistics.maxBusyTime, rBusyTime.second);
+	}
+	mStatistics.averageBusyTime = (mQueues.empty()) ? 0 : totalBusyTime / srt_max(mQueues.size(), mBusyTimes.size());
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileScheduler::SplitGridTile(unsigned int gridTile, unsigned int levels)
+{
+	unsigned int x0 = (gridTile % mTilesPerRow) * mTileSize;
+	unsigned int y0 = (gridTile / mTilesPerRow) * mTileSize;
+	unsigned int x1 = srt_min(x0 + mTileSize, mWidth);
+	unsigned int y1 = srt_min(y0 + mTileSize, mHeight);
+
+	unsigned int size = srt_max(mTileSize >> levels, 1u);
+	for (unsigned int y = y0; y < y1; y += size)
+	{
+		for (unsigned int x = x0; x < x1; x += size)
+		{
+			Tile tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = srt_min(x + size, x1);
+			tile.y1 = srt_min(y + size, y1);
+			tile.gridTile = gridTile;
+			mTiles.push_back(tile);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef TILESCHEDULER_H_
+#define TILESCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <thread>
+
+// rectangle of pixels [x0, x1) x [y0, y1)
+struct Tile
+{
+	unsigned int x0;
+	unsigned int y0;
+	unsigned int x1;
+	unsigned int y1;
+	// tile of the regular grid it was split from
+	unsigned int gridTile;
+
+};
+
+struct TileSchedulerStatistics
+{
+	unsigned int numberOfTiles;
+	// tiles of the regular grid that were split for being expensive in the previous frame
+	unsigned int splitGridTiles;
+	// tiles taken from the deque of another worker
+	unsigned int steals;
+	// seconds spent tracing tiles by the busiest thread and by the average one
+	double maxBusyTime;
+	double averageBusyTime;
+
+	TileSchedulerStatistics() :
+		numberOfTiles(0),
+		splitGridTiles(0),
+		steals(0),
+		maxBusyTime(0),
+		averageBusyTime(0)
+	{
+	}
+
+	// how much longer the busiest thread worked than the average one (0 is a perfectly balanced frame)
+	inline double LoadImbalance() const
+	{
+		return (averageBusyTime > 0) ? maxBusyTime / averageBusyTime - 1 : 0;
+	}
+
+};
+
+// hands out the tiles of a frame to the workers tracing it. every worker has a deque of tiles, takes them from its front
+// and, once it runs dry, steals from the back of the others'. the tiles of the regular grid that took the longest in the
+// previous frame are split into quadrants, so that there are small tiles left to even out the workers at the end
+class TileScheduler
+{
+public:
+	// tiles aren't split below this side
+	static const unsigned int MIN_TILE_SIZE;
+	// expensive tiles are split until they are expected to cost less than 1/TILES_PER_WORKER of a worker's share of the frame
+	static const unsigned int TILES_PER_WORKER;
+
+	TileScheduler();
+	~TileScheduler() = default;
+
+	// drops the tile costs of the previous frame, which would split the next one after pixels of another scene
+	void Reset();
+
+	// splits a width x height frame into tiles and deals them out to the deques of numberOfWorkers workers.
+	// the costs of the previous frame are also dropped whenever the frame or tile size changes
+	void BeginFrame(unsigned int width, unsigned int height, unsigned int tileSize, unsigned int numberOfWorkers);
+
+	// next tile of a worker, false once every deque is empty. safe to call from every worker at once
+	bool NextTile(unsigned int worker, unsigned int& rTile);
+
+	// records how long the calling thread took to trace a tile
+	void EndTile(unsigned int tile, double seconds);
+
+	// gathers the statistics and the tile costs the next frame is split with. every worker must be done
+	void EndFrame();
+
+	inline unsigned int NumberOfTiles() const
+	{
+		return static_cast<unsigned int>(mTiles.size());
+	}
+
+	inline const Tile& GetTile(unsigned int i) const
+	{
+		return mTiles[i];
+	}
+
+	// statistics of the last frame
+	inline const TileSchedulerStatistics& GetStatistics() const
+	{
+		return mStatistics;
+	}
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<unsigned int> tiles;
+		// only written by the worker itself
+		unsigned int steals;
+
+	};
+
+	unsigned int mWidth;
+	unsigned int mHeight;
+	unsigned int mTileSize;
+	unsigned int mTilesPerRow;
+	std::vector<Tile> mTiles;
+	// seconds each tile of the frame took
+	std::vector<double> mTileTimes;
+	// seconds each tile of the grid took in the previous frame (all of them 0 if unknown)
+	std::vector<double> mGridTileCosts;
+	std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+	// seconds each thread spent tracing tiles. a thread can run more than one worker (e.g., the one waiting for the frame
+	// runs queued workers), and a worker that never got a thread leaves one idle, so busy times are kept per thread
+	std::mutex mBusyTimesMutex;
+	std::map<std::thread::id, double> mBusyTimes;
+	TileSchedulerStatistics mStatistics;
+
+	TileScheduler(const TileScheduler&) = delete;
+	TileScheduler& operator=(const TileScheduler&) = delete;
+
+	void SplitGridTile(unsigned int gridTile, unsigned int levels);
+
+};
+
+#endif
\ No newline at end of file
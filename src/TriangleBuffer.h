@@ -0,0 +1,257 @@
+#ifndef TRIANGLEBUFFER_H_
+#define TRIANGLEBUFFER_H_
+
+#include <vector>
+#include <cstring>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "Common.h"
+#include "Ray.h"
+#include "Vector3F.h"
+
+#define srt_triangleIntersectEpsilon 0.000001f
+
+// triangles prepared for the Moller-Trumbore test: first vertex and both edges, in structure of arrays form.
+// slots follow the order of a BVH leaves, so a leaf is a contiguous range of every array
+struct TriangleBuffer
+{
+	std::vector<float> v0x, v0y, v0z;
+	std::vector<float> edge1x, edge1y, edge1z;
+	std::vector<float> edge2x, edge2y, edge2z;
+	// original triangle of each slot
+	std::vector<unsigned int> triangles;
+	// slot of each original triangle (any of them for triangles that several leaves reference)
+	std::vector<unsigned int> slots;
+
+	// number of triangles tested at once by Intersect8
+	static const unsigned int LANES = 8;
+
+	TriangleBuffer() = default;
+	~TriangleBuffer() = default;
+
+	inline unsigned int Size() const
+	{
+		return static_cast<unsigned int>(triangles.size());
+	}
+
+	void Build(const std::vector<Vector3F>& rVertices, const std::vector<unsigned int>& rIndices, const std::vector<unsigned int>& rOrder)
+	{
+		unsigned int size = static_cast<unsigned int>(rOrder.size());
+		v0x.resize(size); v0y.resize(size); v0z.resize(size);
+		edge1x.resize(size); edge1y.resize(size); edge1z.resize(size);
+		edge2x.resize(size); edge2y.resize(size); edge2z.resize(size);
+		triangles.resize(size);
+		slots.assign(rIndices.size() / 3, 0);
+
+		for (unsigned int slot = 0; slot < size; slot++)
+		{
+			unsigned int triangle = rOrder[slot];
+			const Vector3F& rP1 = rVertices[rIndices[triangle * 3]];
+			const Vector3F& rP2 = rVertices[rIndices[triangle * 3 + 1]];
+			const Vector3F& rP3 = rVertices[rIndices[triangle * 3 + 2]];
+
+			Vector3F edge1 = (rP2 - rP1);
+			Vector3F edge2 = (rP3 - rP1);
+
+			v0x[slot] = rP1.x(); v0y[slot] = rP1.y(); v0z[slot] = rP1.z();
+			edge1x[slot] = edge1.x(); edge1y[slot] = edge1.y(); edge1z[slot] = edge1.z();
+			edge2x[slot] = edge2.x(); edge2y[slot] = edge2.y(); edge2z[slot] = edge2.z();
+			triangles[slot] = triangle;
+			slots[triangle] = slot;
+		}
+
+		// zeroed padding lets Intersect8 load full lanes past the last triangle. degenerate triangles never pass the determinant test
+		unsigned int paddedSize = size + LANES - 1;
+		v0x.resize(paddedSize, 0); v0y.resize(paddedSize, 0); v0z.resize(paddedSize, 0);
+		edge1x.resize(paddedSize, 0); edge1y.resize(paddedSize, 0); edge1z.resize(paddedSize, 0);
+		edge2x.resize(paddedSize, 0); edge2y.resize(paddedSize, 0); edge2z.resize(paddedSize, 0);
+	}
+
+	// tests the ray against the slots [first, first + count), count <= LANES, with the same semantics as BackFaceCullTriangleIntersection.
+	// returns a bit mask of the slots that were hit, their ray parameters and barycentrics are written to pT, pU and pV
+	inline unsigned int Intersect8(const Ray& rRay, unsigned int first, unsigned int count, bool mirrored, float* pT, float* pU, float* pV) const
+	{
+#ifdef __AVX__
+		// every operation is done in the same order as in the scalar version so that both agree to the bit
+		const float* pEdge1[3] = { &edge1x[first], &edge1y[first], &edge1z[first] };
+		const float* pEdge2[3] = { &edge2x[first], &edge2y[first], &edge2z[first] };
+		if (mirrored)
+		{
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				const float* pTmp = pEdge1[i];
+				pEdge1[i] = pEdge2[i];
+				pEdge2[i] = pTmp;
+			}
+		}
+
+		__m256 e1x = _mm256_loadu_ps(pEdge1[0]), e1y = _mm256_loadu_ps(pEdge1[1]), e1z = _mm256_loadu_ps(pEdge1[2]);
+		__m256 e2x = _mm256_loadu_ps(pEdge2[0]), e2y = _mm256_loadu_ps(pEdge2[1]), e2z = _mm256_loadu_ps(pEdge2[2]);
+		__m256 dx = _mm256_set1_ps(rRay.direction.x()), dy = _mm256_set1_ps(rRay.direction.y()), dz = _mm256_set1_ps(rRay.direction.z());
+
+		// pvec = direction x edge2
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+		__m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+
+		// tvec = origin - v0
+		__m256 tx = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.x()), _mm256_loadu_ps(&v0x[first]));
+		__m256 ty = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.y()), _mm256_loadu_ps(&v0y[first]));
+		__m256 tz = _mm256_sub_ps(_mm256_set1_ps(rRay.origin.z()), _mm256_loadu_ps(&v0z[first]));
+
+		__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz));
+
+		// qvec = tvec x edge1
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz));
+		__m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz));
+
+		// the scalar version rejects on "<" and ">", so NaNs pass: negated unordered comparisons keep that behavior
+		__m256 zero = _mm256_setzero_ps();
+		__m256 hit = _mm256_cmp_ps(determinant, _mm256_set1_ps(srt_triangleIntersectEpsilon), _CMP_NLT_UQ);
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(a, zero, _CMP_NLT_UQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(a, determinant, _CMP_NGT_UQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(b, zero, _CMP_NLT_UQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(a, b), determinant, _CMP_NGT_UQ));
+
+		unsigned int mask = static_cast<unsigned int>(_mm256_movemask_ps(hit)) & ((1u << count) - 1);
+		if (mask == 0)
+		{
+			return 0;
+		}
+
+		__m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.0f), determinant);
+		a = _mm256_mul_ps(a, inverseDeterminant);
+		b = _mm256_mul_ps(b, inverseDeterminant);
+		_mm256_storeu_ps(pT, _mm256_mul_ps(t, inverseDeterminant));
+		_mm256_storeu_ps(pU, (mirrored) ? b : a);
+		_mm256_storeu_ps(pV, (mirrored) ? a : b);
+
+		return mask;
+#else
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (BackFaceCullTriangleIntersection(rRay, first + i, mirrored, pU[i], pV[i], pT[i]))
+			{
+				mask |= (1u << i);
+			}
+		}
+		return mask;
+#endif
+	}
+
+	// runs Intersect8 and BackFaceCullTriangleIntersection on the same rays, in both windings, and returns the number of
+	// lanes where they disagree on hit/miss, t, u or v (bitwise). every slot gets rays from pseudo-random directions aimed at
+	// its centroid, its first vertex and the middle of its first edge, so front, back, interior and boundary hits are covered
+	unsigned int CountIntersect8Mismatches() const
+	{
+		unsigned int size = Size();
+		unsigned int mismatches = 0;
+		unsigned int seed = 1;
+		for (unsigned int slot = 0; slot < size; slot++)
+		{
+			Vector3F v0(v0x[slot], v0y[slot], v0z[slot]);
+			Vector3F edge1(edge1x[slot], edge1y[slot], edge1z[slot]);
+			Vector3F edge2(edge2x[slot], edge2y[slot], edge2z[slot]);
+			Vector3F targets[3] = { v0 + (edge1 + edge2) / 3.0f, v0, v0 + edge1 * 0.5f };
+			float distance = srt_max(edge1.Length(), edge2.Length()) * 4 + 1;
+			for (const Vector3F& rTarget : targets)
+			{
+				Vector3F direction;
+				for (unsigned int i = 0; i < 3; i++)
+				{
+					seed = seed * 1664525u + 1013904223u;
+					direction[i] = (seed >> 8) / 8388608.0f - 1.0f;
+				}
+				if (direction.Length() == 0)
+				{
+					continue;
+				}
+				direction.Normalize();
+				Ray ray(rTarget - direction * distance, direction);
+
+				unsigned int count = srt_min(size - slot, LANES);
+				for (unsigned int mirrored = 0; mirrored < 2; mirrored++)
+				{
+					float ts[LANES], us[LANES], vs[LANES];
+					unsigned int mask = Intersect8(ray, slot, count, mirrored != 0, ts, us, vs);
+					for (unsigned int lane = 0; lane < count; lane++)
+					{
+						float t, u, v;
+						bool hit = BackFaceCullTriangleIntersection(ray, slot + lane, mirrored != 0, u, v, t);
+						if (hit != ((mask & (1u << lane)) != 0) ||
+							(hit && (memcmp(&t, &ts[lane], sizeof(float)) != 0 || memcmp(&u, &us[lane], sizeof(float)) != 0 || memcmp(&v, &vs[lane], sizeof(float)) != 0)))
+						{
+							mismatches++;
+						}
+					}
+				}
+			}
+		}
+		return mismatches;
+	}
+
+	// Moller-Trumbore with back-face culling. mirrored swaps the edges (and so the winding), u and v stay relative to the original vertex order
+	inline bool BackFaceCullTriangleIntersection(const Ray& rRay, unsigned int slot, bool mirrored, float& u, float& v, float& t) const
+	{
+		Vector3F rEdge1(edge1x[slot], edge1y[slot], edge1z[slot]);
+		Vector3F rEdge2(edge2x[slot], edge2y[slot], edge2z[slot]);
+		if (mirrored)
+		{
+			Vector3F tmp = rEdge1;
+			rEdge1 = rEdge2;
+			rEdge2 = tmp;
+		}
+
+		Vector3F rPVec = rRay.direction.Cross(rEdge2);
+
+		float determinant = rEdge1.Dot(rPVec);
+
+		if (determinant < srt_triangleIntersectEpsilon)
+		{
+			return false;
+		}
+
+		Vector3F rTVec = (rRay.origin - Vector3F(v0x[slot], v0y[slot], v0z[slot]));
+
+		float a = rTVec.Dot(rPVec);
+
+		if (a < 0.0f || a > determinant)
+		{
+			return false;
+		}
+
+		Vector3F rQVec = rTVec.Cross(rEdge1);
+
+		float b = rRay.direction.Dot(rQVec);
+
+		if (b < 0.0f || a + b > determinant)
+		{
+			return false;
+		}
+
+		t = rEdge2.Dot(rQVec);
+
+		float inverseDeterminant = 1.0f / determinant;
+
+		a *= inverseDeterminant;
+		b *= inverseDeterminant;
+		t *= inverseDeterminant;
+
+		u = (mirrored) ? b : a;
+		v = (mirrored) ? a : b;
+
+		return true;
+	}
+
+};
+
+#endif
\ No newline at end of file
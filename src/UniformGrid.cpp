@@ -0,0 +1,231 @@
+#include <cmath>
+
+#include "UniformGrid.h"
+
+const float UniformGrid::DEFAULT_DENSITY = 3.0f;
+const unsigned int UniformGrid::MAX_RESOLUTION = 128;
+
+//////////////////////////////////////////////////////////////////////////
+UniformGrid::UniformGrid(float density) :
+	mDensity(density)
+{
+	mResolution[0] = mResolution[1] = mResolution[2] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void UniformGrid::Update(const std::vector<AABB>& rPrimitiveBounds)
+{
+	if (!mCellOffsets.empty() && rPrimitiveBounds == mPrimitiveBounds)
+	{
+		return;
+	}
+
+	Build(rPrimitiveBounds);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void UniformGrid::Clear()
+{
+	mBounds = AABB();
+	mResolution[0] = mResolution[1] = mResolution[2] = 0;
+	mCellOffsets.clear();
+	mCellPrimitives.clear();
+	mPrimitiveBounds.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+size_t UniformGrid::GetMemory() const
+{
+	return (mCellOffsets.size() + mCellPrimitives.size()) * sizeof(unsigned int) + mPrimitiveBounds.size() * sizeof(AABB);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void UniformGrid::Build(const std::vector<AABB>& rPrimitiveBounds)
+{
+	Clear();
+
+	mPrimitiveBounds = rPrimitiveBounds;
+
+	unsigned int numberOfPrimitives = 0;
+	for (unsigned int i = 0; i < rPrimitiveBounds.size(); i++)
+	{
+		if (!rPrimitiveBounds[i].IsEmpty())
+		{
+			mBounds.Expand(rPrimitiveBounds[i]);
+			numberOfPrimitives++;
+		}
+	}
+
+	if (numberOfPrimitives == 0)
+	{
+		return;
+	}
+
+	// cells are roughly cubic and their number grows linearly with the number of primitives.
+	// flat extents are padded so that the grid volume never collapses
+	Vector3F extent = mBounds.Extent();
+	float maximumExtent = srt_max(srt_max(extent.x(), extent.y()), extent.z());
+	float padding = srt_max(maximumExtent * 0.001f, 0.0001f);
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] < padding)
+		{
+			mBounds.minimum[axis] -= padding * 0.5f;
+			mBounds.maximum[axis] += padding * 0.5f;
+			extent[axis] = mBounds.maximum[axis] - mBounds.minimum[axis];
+		}
+	}
+
+	float cellsPerUnit = std::cbrt(mDensity * numberOfPrimitives / (extent.x() * extent.y() * extent.z()));
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		int resolution = static_cast<int>(extent[axis] * cellsPerUnit);
+		mResolution[axis] = static_cast<unsigned int>(srt_clamp(resolution, 1, static_cast<int>(MAX_RESOLUTION)));
+		mCellSize[axis] = extent[axis] / mResolution[axis];
+	}
+
+	// two passes: count the references of every cell, then scatter them
+	unsigned int numberOfCells = NumberOfCells();
+	mCellOffsets.assign(numberOfCells + 1, 0);
+	for (unsigned int pass = 0; pass < 2; pass++)
+	{
+		for (unsigned int i = 0; i < rPrimitiveBounds.size(); i++)
+		{
+			const AABB& rBounds = rPrimitiveBounds[i];
+			if (rBounds.IsEmpty())
+			{
+				continue;
+			}
+
+			unsigned int minimum[3], maximum[3];
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				minimum[axis] = CellCoordinate(rBounds.minimum[axis], axis);
+				maximum[axis] = CellCoordinate(rBounds.maximum[axis], axis);
+			}
+
+			for (unsigned int z = minimum[2]; z <= maximum[2]; z++)
+			{
+				for (unsigned int y = minimum[1]; y <= maximum[1]; y++)
+				{
+					for (unsigned int x = minimum[0]; x <= maximum[0]; x++)
+					{
+						unsigned int cell = (z * mResolution[1] + y) * mResolution[0] + x;
+						if (pass == 0)
+						{
+							mCellOffsets[cell + 1]++;
+						}
+						else
+						{
+							mCellPrimitives[mCellOffsets[cell]++] = i;
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (unsigned int cell = 0; cell < numberOfCells; cell++)
+			{
+				mCellOffsets[cell + 1] += mCellOffsets[cell];
+			}
+			mCellPrimitives.resize(mCellOffsets[numberOfCells]);
+		}
+		else
+		{
+			// the scatter advanced every offset to the start of the next cell
+			for (unsigned int cell = numberOfCells; cell > 0; cell--)
+			{
+				mCellOffsets[cell] = mCellOffsets[cell - 1];
+			}
+			mCellOffsets[0] = 0;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+unsigned int UniformGrid::CellCoordinate(float value, unsigned int axis) const
+{
+	int coordinate = static_cast<int>((value - mBounds.minimum[axis]) / mCellSize[axis]);
+	return static_cast<unsigned int>(srt_clamp(coordinate, 0, static_cast<int>(mResolution[axis]) - 1));
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool UniformGrid::Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const
+{
+	if (mCellOffsets.empty())
+	{
+		return false;
+	}
+
+	float tEntry;
+	if (!mBounds.Intersect(rRay, tEntry))
+	{
+		return false;
+	}
+
+	// 3D-DDA setup: the cell containing the entry point and, per axis, the ray parameter of the next cell boundary
+	Vector3F entryPoint = rRay.origin + tEntry * rRay.direction;
+	int cell[3], step[3], end[3];
+	float tNext[3], tDelta[3];
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		cell[axis] = static_cast<int>(CellCoordinate(entryPoint[axis], axis));
+		if (rRay.direction[axis] > 0)
+		{
+			step[axis] = 1;
+			end[axis] = static_cast<int>(mResolution[axis]);
+			tNext[axis] = (mBounds.minimum[axis] + (cell[axis] + 1) * mCellSize[axis] - rRay.origin[axis]) * rRay.inverseDirection[axis];
+			tDelta[axis] = mCellSize[axis] * rRay.inverseDirection[axis];
+		}
+		else if (rRay.direction[axis] < 0)
+		{
+			step[axis] = -1;
+			end[axis] = -1;
+			tNext[axis] = (mBounds.minimum[axis] + cell[axis] * mCellSize[axis] - rRay.origin[axis]) * rRay.inverseDirection[axis];
+			tDelta[axis] = -mCellSize[axis] * rRay.inverseDirection[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			end[axis] = -1;
+			tNext[axis] = FLT_MAX;
+			tDelta[axis] = FLT_MAX;
+		}
+	}
+
+	bool hit = false;
+	while (true)
+	{
+		unsigned int cellIndex = (cell[2] * mResolution[1] + cell[1]) * mResolution[0] + cell[0];
+		for (unsigned int i = mCellOffsets[cellIndex]; i < mCellOffsets[cellIndex + 1]; i++)
+		{
+			if (intersectPrimitive(pContext, mCellPrimitives[i]))
+			{
+				hit = true;
+				if (anyHit)
+				{
+					return true;
+				}
+			}
+		}
+
+		unsigned int axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+
+		// primitives span several cells, so a hit only ends the walk once the next cell starts beyond it
+		if (tNext[axis] > rRay.tMax || step[axis] == 0)
+		{
+			break;
+		}
+
+		cell[axis] += step[axis];
+		if (cell[axis] == end[axis])
+		{
+			break;
+		}
+		tNext[axis] += tDelta[axis];
+	}
+
+	return hit;
+}
\ No newline at end of file
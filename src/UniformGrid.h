@@ -0,0 +1,49 @@
+#ifndef UNIFORMGRID_H_
+#define UNIFORMGRID_H_
+
+#include <vector>
+
+#include "Accelerator.h"
+#include "AABB.h"
+#include "Ray.h"
+
+// regular subdivision of the primitives bounds, traversed cell by cell with a 3D-DDA
+class UniformGrid : public Accelerator
+{
+public:
+	static const float DEFAULT_DENSITY;
+
+	UniformGrid(float density = DEFAULT_DENSITY);
+	virtual ~UniformGrid() = default;
+
+	virtual void Update(const std::vector<AABB>& rPrimitiveBounds);
+	virtual void Clear();
+	virtual size_t GetMemory() const;
+	virtual bool Traverse(const Ray& rRay, IntersectPrimitiveFunction intersectPrimitive, void* pContext, bool anyHit) const;
+
+	void Build(const std::vector<AABB>& rPrimitiveBounds);
+
+	inline unsigned int NumberOfCells() const
+	{
+		return mResolution[0] * mResolution[1] * mResolution[2];
+	}
+
+private:
+	static const unsigned int MAX_RESOLUTION;
+
+	// average number of cells per primitive
+	float mDensity;
+	AABB mBounds;
+	Vector3F mCellSize;
+	unsigned int mResolution[3];
+	// primitive references of cell i are mCellPrimitives[mCellOffsets[i]..mCellOffsets[i + 1]]
+	std::vector<unsigned int> mCellOffsets;
+	std::vector<unsigned int> mCellPrimitives;
+	// bounds the grid was built with, the grid is only rebuilt when they change
+	std::vector<AABB> mPrimitiveBounds;
+
+	unsigned int CellCoordinate(float value, unsigned int axis) const;
+
+};
+
+#endif
\ No newline at end of file